@@ -0,0 +1,442 @@
+// Choosing Array Kernels at Run Time
+
+/*A program compiled for the oldest processor it must run on cannot use the wider
+instructions of newer ones, and a program compiled for the newest will crash on older
+ones. One way out is to compile every version of a function into the same program and
+choose between them when it starts, once the processor is known.
+
+Function pointers make the choice cheap. At startup, initializeKernels asks the processor
+which instruction sets it supports and stores the address of the best version of each
+kernel in a function pointer, as described in Functionptr/FunctionPointers.c. From then
+on every call goes through the pointer: one indirect call, with no test of the processor
+on the way. The branch predictor learns the target after the first call, so the cost is
+about that of an ordinary call.
+
+The kernels work on arrays of 32-bit integers, like the vector in array.c:
+
+    scale    x[i] = x[i] * value
+    sum      the sum of the elements, as a 64-bit integer so it cannot overflow
+    average  the sum divided by the number of elements
+    fill     x[i] = value
+
+Each has a scalar version and versions for SSE4.2, AVX2 and AVX-512, all giving the same
+results. Multiplication wraps on overflow, as it does in the vector instructions.*/
+
+// Compile with: gcc -O2 kernelDispatch.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <immintrin.h>
+
+/*The function pointer types follow the naming convention suggested in
+FunctionPointers.c, beginning with fptr:*/
+
+typedef void (*fptrScale)(int32_t *, size_t, int32_t);
+typedef int64_t (*fptrSum)(const int32_t *, size_t);
+typedef double (*fptrAverage)(const int32_t *, size_t);
+typedef void (*fptrFill)(int32_t *, size_t, int32_t);
+
+/*Scalar Kernels
+These run on any processor and are the reference for the others. The optimize attribute
+stops the compiler from vectorizing them for the baseline instruction set, so they stay
+one element at a time:*/
+
+#define SCALAR __attribute__((optimize("no-tree-vectorize")))
+
+SCALAR void scaleScalar(int32_t *x, size_t n, int32_t value)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] = (int32_t)((uint32_t)x[i] * (uint32_t)value);
+    }
+}
+
+SCALAR int64_t sumScalar(const int32_t *x, size_t n)
+{
+    int64_t sum = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += x[i];
+    }
+    return sum;
+}
+
+SCALAR void fillScalar(int32_t *x, size_t n, int32_t value)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] = value;
+    }
+}
+
+/*SSE4.2 Kernels
+The sum kernels widen each 32-bit element to 64 bits before adding, so no lane can
+overflow however long the array. _mm_cvtepi32_epi64 sign-extends the two low elements of
+a register, and a shift brings the two high ones down. Two accumulators let consecutive
+additions proceed without waiting for each other:*/
+
+__attribute__((target("sse4.2"))) void scaleSSE42(int32_t *x, size_t n, int32_t value)
+{
+    __m128i v = _mm_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i product = _mm_mullo_epi32(_mm_loadu_si128((__m128i *)(x + i)), v);
+        _mm_storeu_si128((__m128i *)(x + i), product);
+    }
+    scaleScalar(x + i, n - i, value);
+}
+
+__attribute__((target("sse4.2"))) int64_t sumSSE42(const int32_t *x, size_t n)
+{
+    __m128i low = _mm_setzero_si128();
+    __m128i high = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i values = _mm_loadu_si128((const __m128i *)(x + i));
+        low = _mm_add_epi64(low, _mm_cvtepi32_epi64(values));
+        high = _mm_add_epi64(high, _mm_cvtepi32_epi64(_mm_srli_si128(values, 8)));
+    }
+    __m128i total = _mm_add_epi64(low, high);
+    return _mm_extract_epi64(total, 0) + _mm_extract_epi64(total, 1) + sumScalar(x + i, n - i);
+}
+
+__attribute__((target("sse4.2"))) double averageSSE42(const int32_t *x, size_t n)
+{
+    return n == 0 ? 0.0 : (double)sumSSE42(x, n) / n;
+}
+
+__attribute__((target("sse4.2"))) void fillSSE42(int32_t *x, size_t n, int32_t value)
+{
+    __m128i v = _mm_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)(x + i), v);
+    }
+    fillScalar(x + i, n - i, value);
+}
+
+// AVX2 Kernels, the same with registers of eight elements:
+
+__attribute__((target("avx2"))) void scaleAVX2(int32_t *x, size_t n, int32_t value)
+{
+    __m256i v = _mm256_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i product = _mm256_mullo_epi32(_mm256_loadu_si256((__m256i *)(x + i)), v);
+        _mm256_storeu_si256((__m256i *)(x + i), product);
+    }
+    scaleScalar(x + i, n - i, value);
+}
+
+__attribute__((target("avx2"))) int64_t sumAVX2(const int32_t *x, size_t n)
+{
+    __m256i low = _mm256_setzero_si256();
+    __m256i high = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i values = _mm256_loadu_si256((const __m256i *)(x + i));
+        low = _mm256_add_epi64(low, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(values)));
+        high = _mm256_add_epi64(high, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(values, 1)));
+    }
+    __m256i total = _mm256_add_epi64(low, high);
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    return _mm_extract_epi64(half, 0) + _mm_extract_epi64(half, 1) + sumScalar(x + i, n - i);
+}
+
+__attribute__((target("avx2"))) double averageAVX2(const int32_t *x, size_t n)
+{
+    return n == 0 ? 0.0 : (double)sumAVX2(x, n) / n;
+}
+
+__attribute__((target("avx2"))) void fillAVX2(int32_t *x, size_t n, int32_t value)
+{
+    __m256i v = _mm256_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_si256((__m256i *)(x + i), v);
+    }
+    fillScalar(x + i, n - i, value);
+}
+
+/*AVX-512 Kernels
+With sixteen elements per register, the leftover elements can be up to fifteen. AVX-512
+handles them with a mask instead of a scalar loop: the masked load and store touch only
+the lanes whose bit is set, so they never read or write past the end of the array:*/
+
+__attribute__((target("avx512f"))) void scaleAVX512(int32_t *x, size_t n, int32_t value)
+{
+    __m512i v = _mm512_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_si512(x + i, _mm512_mullo_epi32(_mm512_loadu_si512(x + i), v));
+    }
+    __mmask16 rest = (__mmask16)((1u << (n - i)) - 1);
+    _mm512_mask_storeu_epi32(x + i, rest, _mm512_mullo_epi32(_mm512_maskz_loadu_epi32(rest, x + i), v));
+}
+
+__attribute__((target("avx512f"))) int64_t sumAVX512(const int32_t *x, size_t n)
+{
+    __m512i low = _mm512_setzero_si512();
+    __m512i high = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i values = _mm512_loadu_si512(x + i);
+        low = _mm512_add_epi64(low, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(values)));
+        high = _mm512_add_epi64(high, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(values, 1)));
+    }
+    __mmask16 rest = (__mmask16)((1u << (n - i)) - 1);
+    __m512i values = _mm512_maskz_loadu_epi32(rest, x + i);
+    low = _mm512_add_epi64(low, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(values)));
+    high = _mm512_add_epi64(high, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(values, 1)));
+    return _mm512_reduce_add_epi64(_mm512_add_epi64(low, high));
+}
+
+__attribute__((target("avx512f"))) double averageAVX512(const int32_t *x, size_t n)
+{
+    return n == 0 ? 0.0 : (double)sumAVX512(x, n) / n;
+}
+
+__attribute__((target("avx512f"))) void fillAVX512(int32_t *x, size_t n, int32_t value)
+{
+    __m512i v = _mm512_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_si512(x + i, v);
+    }
+    _mm512_mask_storeu_epi32(x + i, (__mmask16)((1u << (n - i)) - 1), v);
+}
+
+SCALAR double averageScalar(const int32_t *x, size_t n)
+{
+    return n == 0 ? 0.0 : (double)sumScalar(x, n) / n;
+}
+
+/*The Dispatch Table
+Each level of the instruction set has a row of kernels, from the scalar ones up. The
+kernels in use are kept together in arrayKernels, and the rest of the program calls
+them only through it:*/
+
+typedef struct _kernelSet
+{
+    const char *name;
+    fptrScale scale;
+    fptrSum sum;
+    fptrAverage average;
+    fptrFill fill;
+} KernelSet;
+
+#define KERNEL_LEVELS 4
+
+KernelSet kernelLevels[KERNEL_LEVELS] = {
+    {"scalar", scaleScalar, sumScalar, averageScalar, fillScalar},
+    {"SSE4.2", scaleSSE42, sumSSE42, averageSSE42, fillSSE42},
+    {"AVX2", scaleAVX2, sumAVX2, averageAVX2, fillAVX2},
+    {"AVX-512", scaleAVX512, sumAVX512, averageAVX512, fillAVX512},
+};
+
+KernelSet arrayKernels;
+
+/*levelSupported tells whether the processor can run a level. __builtin_cpu_supports only
+accepts a string literal, so each feature is named in its own case:*/
+
+int levelSupported(int level)
+{
+    switch (level)
+    {
+    case 0:
+        return 1;
+    case 1:
+        return __builtin_cpu_supports("sse4.2");
+    case 2:
+        return __builtin_cpu_supports("avx2");
+    case 3:
+        return __builtin_cpu_supports("avx512f");
+    }
+    return 0;
+}
+
+/*initializeKernels binds arrayKernels to the highest level the processor supports. The
+environment variable ARRAY_KERNELS can name a lower level, such as AVX2 or scalar, which
+is useful for testing the other paths, or for avoiding AVX-512 on processors that lower
+their clock speed while running it. It returns the name of the level chosen:*/
+
+const char *initializeKernels()
+{
+    __builtin_cpu_init();
+    const char *limit = getenv("ARRAY_KERNELS");
+    int chosen = 0;
+    for (int level = 1; level < KERNEL_LEVELS && levelSupported(level); level++)
+    {
+        chosen = level;
+        if (limit != NULL && strcmp(limit, kernelLevels[level].name) == 0)
+        {
+            break;
+        }
+    }
+    if (limit != NULL && strcmp(limit, "scalar") == 0)
+    {
+        chosen = 0;
+    }
+    arrayKernels = kernelLevels[chosen];
+    return arrayKernels.name;
+}
+
+/*The program checks every supported level against the scalar kernels on arrays of many
+lengths, so that every tail is tested. It then times each level on a million elements,
+and finally compares a call through arrayKernels with a direct call to the same kernel
+by name on a short array, where the cost of the call itself is most visible. The empty
+asm statement tells the compiler that the array may have changed, so neither loop can
+compute the sum once and reuse it:*/
+
+#define ELEMENTS 1000000
+#define REPEAT 50
+
+double elapsedMilliseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void makeValues(int32_t *x, size_t n)
+{
+    uint32_t state = 12345;
+    for (size_t i = 0; i < n; i++)
+    {
+        state = state * 1664525u + 1013904223u;
+        x[i] = (int32_t)state;
+    }
+}
+
+int main()
+{
+    const char *chosen = initializeKernels();
+    printf("bound kernels: %s\n\n", chosen);
+
+    int32_t *x = (int32_t *)malloc(ELEMENTS * sizeof(int32_t));
+    int32_t *expected = (int32_t *)malloc(ELEMENTS * sizeof(int32_t));
+    printf("level\tscale\tsum\taverage\tfill\t(ms per million elements)\n");
+    for (int level = 0; level < KERNEL_LEVELS; level++)
+    {
+        KernelSet *set = &kernelLevels[level];
+        if (!levelSupported(level))
+        {
+            printf("%s\tnot supported\n", set->name);
+            continue;
+        }
+        int mismatches = 0;
+        for (size_t n = 0; n < 100; n++)
+        {
+            makeValues(expected, n);
+            scaleScalar(expected, n, -7);
+            makeValues(x, n);
+            set->scale(x, n, -7);
+            mismatches += memcmp(x, expected, n * sizeof(int32_t)) != 0;
+            mismatches += set->sum(x, n) != sumScalar(x, n);
+            mismatches += set->average(x, n) != averageScalar(x, n);
+            fillScalar(expected, n, 42);
+            set->fill(x, n, 42);
+            mismatches += memcmp(x, expected, n * sizeof(int32_t)) != 0;
+        }
+
+        double best[4] = {1e30, 1e30, 1e30, 1e30};
+        volatile int64_t sink = 0;
+        makeValues(x, ELEMENTS);
+        for (int r = 0; r < REPEAT; r++)
+        {
+            struct timespec t0, t1, t2, t3, t4;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            set->scale(x, ELEMENTS, 3);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            sink += set->sum(x, ELEMENTS);
+            clock_gettime(CLOCK_MONOTONIC, &t2);
+            sink += (int64_t)set->average(x, ELEMENTS);
+            clock_gettime(CLOCK_MONOTONIC, &t3);
+            set->fill(x, ELEMENTS, r);
+            clock_gettime(CLOCK_MONOTONIC, &t4);
+            double ms[4] = {elapsedMilliseconds(&t0, &t1), elapsedMilliseconds(&t1, &t2),
+                            elapsedMilliseconds(&t2, &t3), elapsedMilliseconds(&t3, &t4)};
+            for (int k = 0; k < 4; k++)
+            {
+                best[k] = ms[k] < best[k] ? ms[k] : best[k];
+            }
+        }
+        printf("%s\t%.3f\t%.3f\t%.3f\t%.3f\t%s\n", set->name, best[0], best[1], best[2], best[3],
+               mismatches == 0 ? "matches scalar" : "MISMATCH");
+    }
+
+    // Call overhead: 16 elements, ten million calls, through the pointer and directly
+    int32_t small[16];
+    makeValues(small, 16);
+    struct timespec start, end;
+    int64_t total = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < 10000000; i++)
+    {
+        __asm__ volatile("" : : "r"(small) : "memory");
+        total += arrayKernels.sum(small, 16);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double indirect = elapsedMilliseconds(&start, &end);
+    int level = KERNEL_LEVELS - 1;
+    while (level > 0 && kernelLevels[level].sum != arrayKernels.sum)
+    {
+        level--;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    switch (level)
+    {
+    case 3:
+        for (int i = 0; i < 10000000; i++)
+        {
+            __asm__ volatile("" : : "r"(small) : "memory");
+            total -= sumAVX512(small, 16);
+        }
+        break;
+    case 2:
+        for (int i = 0; i < 10000000; i++)
+        {
+            __asm__ volatile("" : : "r"(small) : "memory");
+            total -= sumAVX2(small, 16);
+        }
+        break;
+    case 1:
+        for (int i = 0; i < 10000000; i++)
+        {
+            __asm__ volatile("" : : "r"(small) : "memory");
+            total -= sumSSE42(small, 16);
+        }
+        break;
+    default:
+        for (int i = 0; i < 10000000; i++)
+        {
+            __asm__ volatile("" : : "r"(small) : "memory");
+            total -= sumScalar(small, 16);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("\nsum of 16 elements: %.2f ns through arrayKernels, %.2f ns calling %s directly%s\n",
+           indirect / 10, elapsedMilliseconds(&start, &end) / 10, kernelLevels[level].name,
+           total == 0 ? "" : " (MISMATCH)");
+
+    free(expected);
+    free(x);
+    return 0;
+}
+
+/*The call through arrayKernels costs little more than calling the kernel by name: a load
+of the address and an indirect call, which the processor predicts correctly every time.
+The kernels are compiled with different options than main, so the compiler does not
+inline them, and the direct loop measures a plain call. For arrays of any real size that
+is negligible next to the work of the kernel, and the program never checks the processor
+again after startup. On a million elements the levels above SSE4.2 differ little, because
+the kernels are limited by memory bandwidth rather than by the width of the registers.*/
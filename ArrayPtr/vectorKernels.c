@@ -0,0 +1,610 @@
+// Vector Kernels for Array Operations
+
+/*The last loop in array.c multiplies every element of a vector by a value:
+
+    for (int i = 0; i < 5; i++)
+    {
+        *pv++ *= value;
+    }
+
+Each iteration handles one element. SIMD instructions handle several at once: a 128-bit
+SSE register holds four ints or floats, or two doubles, and a 256-bit AVX2 register twice
+as many. The same loop can then advance four or eight elements per instruction.
+
+This file provides three such operations for arrays of int32_t, float and double:
+
+    scale   x[i] = x[i] * value
+    add     x[i] = x[i] + y[i]
+    fma     y[i] = a * x[i] + y[i]
+
+Each comes in a scalar version, which is the reference, and SIMD versions that must give
+exactly the same results, bit for bit. For the integer kernels that is automatic, as long
+as the scalar version wraps on overflow the way the SIMD instructions do rather than
+relying on signed overflow, which is undefined. For the floating-point kernels, scale and
+add perform the same single IEEE operation in every lane, so they also agree. Fused
+multiply-add rounds only once, so it agrees with the scalar version only if the scalar
+version also rounds once, which the fma and fmaf functions of the C library do. SSE has
+no fused multiply-add instruction, so for float and double the fma kernel only has an
+AVX2 version, which uses the FMA instructions that every AVX2 processor also provides.*/
+
+// Compile with: gcc -O2 vectorKernels.c -lm
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <immintrin.h>
+
+/*Scalar Kernels
+These are the loop from array.c, written as functions over an array and its size. The
+optimize attribute keeps the compiler from vectorizing them on its own, so they remain a
+true one-element-at-a-time baseline:*/
+
+#define SCALAR __attribute__((optimize("no-tree-vectorize")))
+
+/*fmaf and fma are exact, but unless the whole program is compiled for a processor with
+FMA instructions, they are calls into the C library, which may compute them in software
+at a hundred times the cost of a multiply. The scalar fma kernels therefore use the
+scalar FMA instruction, one element at a time, whenever the processor has it. This only
+makes them faster; the result is the same either way:*/
+
+int supportsFMA = 0;
+
+SCALAR __attribute__((target("fma"))) void fmaFloatScalarFMA(float *y, const float *x, size_t n, float a)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        y[i] = __builtin_fmaf(a, x[i], y[i]);
+    }
+}
+
+SCALAR __attribute__((target("fma"))) void fmaDoubleScalarFMA(double *y, const double *x, size_t n, double a)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        y[i] = __builtin_fma(a, x[i], y[i]);
+    }
+}
+
+SCALAR void scaleInt32Scalar(int32_t *x, size_t n, int32_t value)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] = (int32_t)((uint32_t)x[i] * (uint32_t)value);
+    }
+}
+
+SCALAR void addInt32Scalar(int32_t *x, const int32_t *y, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] = (int32_t)((uint32_t)x[i] + (uint32_t)y[i]);
+    }
+}
+
+SCALAR void fmaInt32Scalar(int32_t *y, const int32_t *x, size_t n, int32_t a)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        y[i] = (int32_t)((uint32_t)a * (uint32_t)x[i] + (uint32_t)y[i]);
+    }
+}
+
+SCALAR void scaleFloatScalar(float *x, size_t n, float value)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] *= value;
+    }
+}
+
+SCALAR void addFloatScalar(float *x, const float *y, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] += y[i];
+    }
+}
+
+SCALAR void fmaFloatScalar(float *y, const float *x, size_t n, float a)
+{
+    if (supportsFMA)
+    {
+        fmaFloatScalarFMA(y, x, n, a);
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        y[i] = fmaf(a, x[i], y[i]);
+    }
+}
+
+SCALAR void scaleDoubleScalar(double *x, size_t n, double value)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] *= value;
+    }
+}
+
+SCALAR void addDoubleScalar(double *x, const double *y, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] += y[i];
+    }
+}
+
+SCALAR void fmaDoubleScalar(double *y, const double *x, size_t n, double a)
+{
+    if (supportsFMA)
+    {
+        fmaDoubleScalarFMA(y, x, n, a);
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        y[i] = fma(a, x[i], y[i]);
+    }
+}
+
+/*The SIMD Kernels
+Every SIMD kernel has the same three parts. First, single elements are processed until
+the array being written is aligned to the register width, so that all of its loads and
+stores in the main loop are aligned ones. Second, the main loop processes a full register
+at a time. When the array that is only read happens to be aligned as well, which is the
+usual case for arrays from aligned_alloc, the main loop uses aligned loads for it too;
+otherwise it uses unaligned loads. Third, the elements left over at the end, fewer than
+fill a register, are processed one at a time by the scalar kernel.
+
+isAligned tests an address against a register width:*/
+
+int isAligned(const void *address, size_t width)
+{
+    return ((uintptr_t)address & (width - 1)) == 0;
+}
+
+/*SSE kernels. Multiplying 32-bit integers lane by lane needs SSE4.1, the rest SSE2. The
+prologue counts how many elements precede the first aligned one, capped at n:*/
+
+size_t leadingElements(const void *x, size_t elementSize, size_t width, size_t n)
+{
+    size_t misalignment = (uintptr_t)x & (width - 1);
+    size_t lead = misalignment == 0 ? 0 : (width - misalignment) / elementSize;
+    return lead < n ? lead : n;
+}
+
+__attribute__((target("sse4.1"))) void scaleInt32SSE(int32_t *x, size_t n, int32_t value)
+{
+    size_t i = leadingElements(x, sizeof(int32_t), 16, n);
+    scaleInt32Scalar(x, i, value);
+    __m128i v = _mm_set1_epi32(value);
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_store_si128((__m128i *)(x + i), _mm_mullo_epi32(_mm_load_si128((__m128i *)(x + i)), v));
+    }
+    scaleInt32Scalar(x + i, n - i, value);
+}
+
+__attribute__((target("sse2"))) void addInt32SSE(int32_t *x, const int32_t *y, size_t n)
+{
+    size_t i = leadingElements(x, sizeof(int32_t), 16, n);
+    addInt32Scalar(x, y, i);
+    if (isAligned(y + i, 16))
+    {
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128i sum = _mm_add_epi32(_mm_load_si128((__m128i *)(x + i)), _mm_load_si128((const __m128i *)(y + i)));
+            _mm_store_si128((__m128i *)(x + i), sum);
+        }
+    }
+    else
+    {
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128i sum = _mm_add_epi32(_mm_load_si128((__m128i *)(x + i)), _mm_loadu_si128((const __m128i *)(y + i)));
+            _mm_store_si128((__m128i *)(x + i), sum);
+        }
+    }
+    addInt32Scalar(x + i, y + i, n - i);
+}
+
+__attribute__((target("sse4.1"))) void fmaInt32SSE(int32_t *y, const int32_t *x, size_t n, int32_t a)
+{
+    size_t i = leadingElements(y, sizeof(int32_t), 16, n);
+    fmaInt32Scalar(y, x, i, a);
+    __m128i va = _mm_set1_epi32(a);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i product = _mm_mullo_epi32(_mm_loadu_si128((const __m128i *)(x + i)), va);
+        _mm_store_si128((__m128i *)(y + i), _mm_add_epi32(product, _mm_load_si128((__m128i *)(y + i))));
+    }
+    fmaInt32Scalar(y + i, x + i, n - i, a);
+}
+
+__attribute__((target("sse2"))) void scaleFloatSSE(float *x, size_t n, float value)
+{
+    size_t i = leadingElements(x, sizeof(float), 16, n);
+    scaleFloatScalar(x, i, value);
+    __m128 v = _mm_set1_ps(value);
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_store_ps(x + i, _mm_mul_ps(_mm_load_ps(x + i), v));
+    }
+    scaleFloatScalar(x + i, n - i, value);
+}
+
+__attribute__((target("sse2"))) void addFloatSSE(float *x, const float *y, size_t n)
+{
+    size_t i = leadingElements(x, sizeof(float), 16, n);
+    addFloatScalar(x, y, i);
+    if (isAligned(y + i, 16))
+    {
+        for (; i + 4 <= n; i += 4)
+        {
+            _mm_store_ps(x + i, _mm_add_ps(_mm_load_ps(x + i), _mm_load_ps(y + i)));
+        }
+    }
+    else
+    {
+        for (; i + 4 <= n; i += 4)
+        {
+            _mm_store_ps(x + i, _mm_add_ps(_mm_load_ps(x + i), _mm_loadu_ps(y + i)));
+        }
+    }
+    addFloatScalar(x + i, y + i, n - i);
+}
+
+__attribute__((target("sse2"))) void scaleDoubleSSE(double *x, size_t n, double value)
+{
+    size_t i = leadingElements(x, sizeof(double), 16, n);
+    scaleDoubleScalar(x, i, value);
+    __m128d v = _mm_set1_pd(value);
+    for (; i + 2 <= n; i += 2)
+    {
+        _mm_store_pd(x + i, _mm_mul_pd(_mm_load_pd(x + i), v));
+    }
+    scaleDoubleScalar(x + i, n - i, value);
+}
+
+__attribute__((target("sse2"))) void addDoubleSSE(double *x, const double *y, size_t n)
+{
+    size_t i = leadingElements(x, sizeof(double), 16, n);
+    addDoubleScalar(x, y, i);
+    if (isAligned(y + i, 16))
+    {
+        for (; i + 2 <= n; i += 2)
+        {
+            _mm_store_pd(x + i, _mm_add_pd(_mm_load_pd(x + i), _mm_load_pd(y + i)));
+        }
+    }
+    else
+    {
+        for (; i + 2 <= n; i += 2)
+        {
+            _mm_store_pd(x + i, _mm_add_pd(_mm_load_pd(x + i), _mm_loadu_pd(y + i)));
+        }
+    }
+    addDoubleScalar(x + i, y + i, n - i);
+}
+
+/*AVX2 kernels. These are the SSE kernels with registers twice as wide, plus the fused
+multiply-add for float and double:*/
+
+__attribute__((target("avx2"))) void scaleInt32AVX2(int32_t *x, size_t n, int32_t value)
+{
+    size_t i = leadingElements(x, sizeof(int32_t), 32, n);
+    scaleInt32Scalar(x, i, value);
+    __m256i v = _mm256_set1_epi32(value);
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_store_si256((__m256i *)(x + i), _mm256_mullo_epi32(_mm256_load_si256((__m256i *)(x + i)), v));
+    }
+    scaleInt32Scalar(x + i, n - i, value);
+}
+
+__attribute__((target("avx2"))) void addInt32AVX2(int32_t *x, const int32_t *y, size_t n)
+{
+    size_t i = leadingElements(x, sizeof(int32_t), 32, n);
+    addInt32Scalar(x, y, i);
+    if (isAligned(y + i, 32))
+    {
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256i sum = _mm256_add_epi32(_mm256_load_si256((__m256i *)(x + i)),
+                                           _mm256_load_si256((const __m256i *)(y + i)));
+            _mm256_store_si256((__m256i *)(x + i), sum);
+        }
+    }
+    else
+    {
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256i sum = _mm256_add_epi32(_mm256_load_si256((__m256i *)(x + i)),
+                                           _mm256_loadu_si256((const __m256i *)(y + i)));
+            _mm256_store_si256((__m256i *)(x + i), sum);
+        }
+    }
+    addInt32Scalar(x + i, y + i, n - i);
+}
+
+__attribute__((target("avx2"))) void fmaInt32AVX2(int32_t *y, const int32_t *x, size_t n, int32_t a)
+{
+    size_t i = leadingElements(y, sizeof(int32_t), 32, n);
+    fmaInt32Scalar(y, x, i, a);
+    __m256i va = _mm256_set1_epi32(a);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i product = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)(x + i)), va);
+        _mm256_store_si256((__m256i *)(y + i), _mm256_add_epi32(product, _mm256_load_si256((__m256i *)(y + i))));
+    }
+    fmaInt32Scalar(y + i, x + i, n - i, a);
+}
+
+__attribute__((target("avx2"))) void scaleFloatAVX2(float *x, size_t n, float value)
+{
+    size_t i = leadingElements(x, sizeof(float), 32, n);
+    scaleFloatScalar(x, i, value);
+    __m256 v = _mm256_set1_ps(value);
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_store_ps(x + i, _mm256_mul_ps(_mm256_load_ps(x + i), v));
+    }
+    scaleFloatScalar(x + i, n - i, value);
+}
+
+__attribute__((target("avx2"))) void addFloatAVX2(float *x, const float *y, size_t n)
+{
+    size_t i = leadingElements(x, sizeof(float), 32, n);
+    addFloatScalar(x, y, i);
+    if (isAligned(y + i, 32))
+    {
+        for (; i + 8 <= n; i += 8)
+        {
+            _mm256_store_ps(x + i, _mm256_add_ps(_mm256_load_ps(x + i), _mm256_load_ps(y + i)));
+        }
+    }
+    else
+    {
+        for (; i + 8 <= n; i += 8)
+        {
+            _mm256_store_ps(x + i, _mm256_add_ps(_mm256_load_ps(x + i), _mm256_loadu_ps(y + i)));
+        }
+    }
+    addFloatScalar(x + i, y + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void fmaFloatAVX2(float *y, const float *x, size_t n, float a)
+{
+    size_t i = leadingElements(y, sizeof(float), 32, n);
+    fmaFloatScalar(y, x, i, a);
+    __m256 va = _mm256_set1_ps(a);
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_store_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_load_ps(y + i)));
+    }
+    fmaFloatScalar(y + i, x + i, n - i, a);
+}
+
+__attribute__((target("avx2"))) void scaleDoubleAVX2(double *x, size_t n, double value)
+{
+    size_t i = leadingElements(x, sizeof(double), 32, n);
+    scaleDoubleScalar(x, i, value);
+    __m256d v = _mm256_set1_pd(value);
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm256_store_pd(x + i, _mm256_mul_pd(_mm256_load_pd(x + i), v));
+    }
+    scaleDoubleScalar(x + i, n - i, value);
+}
+
+__attribute__((target("avx2"))) void addDoubleAVX2(double *x, const double *y, size_t n)
+{
+    size_t i = leadingElements(x, sizeof(double), 32, n);
+    addDoubleScalar(x, y, i);
+    if (isAligned(y + i, 32))
+    {
+        for (; i + 4 <= n; i += 4)
+        {
+            _mm256_store_pd(x + i, _mm256_add_pd(_mm256_load_pd(x + i), _mm256_load_pd(y + i)));
+        }
+    }
+    else
+    {
+        for (; i + 4 <= n; i += 4)
+        {
+            _mm256_store_pd(x + i, _mm256_add_pd(_mm256_load_pd(x + i), _mm256_loadu_pd(y + i)));
+        }
+    }
+    addDoubleScalar(x + i, y + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void fmaDoubleAVX2(double *y, const double *x, size_t n, double a)
+{
+    size_t i = leadingElements(y, sizeof(double), 32, n);
+    fmaDoubleScalar(y, x, i, a);
+    __m256d va = _mm256_set1_pd(a);
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm256_store_pd(y + i, _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i), _mm256_load_pd(y + i)));
+    }
+    fmaDoubleScalar(y + i, x + i, n - i, a);
+}
+
+/*Testing and Timing
+Each kernel is run on the same input as its scalar version and the outputs are compared
+with memcmp, first on aligned arrays and then with every array offset by one element so
+that the prologue, the unaligned main loop, and the tail are all exercised. Then each
+kernel is timed at two sizes: 16384 elements, which stay in the first- or second-level
+cache, and a million elements, which do not. A kernel the processor cannot run is
+reported as n/a.
+
+Function pointers let one driver handle every kernel of a type. The kernels of the three
+types differ only in the element type, so the driver is written once with a macro:*/
+
+#define CACHED_ELEMENTS 16384
+#define ELEMENTS 1000000
+#define REPEAT 50
+
+double elapsedMilliseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int supportsAVX2 = 0;
+int supportsSSE41 = 0;
+
+#define DEFINE_DRIVER(TYPE, NAME, MAKE)                                                                     \
+    typedef void (*SCALE_##NAME)(TYPE *, size_t, TYPE);                                                    \
+    typedef void (*ADD_##NAME)(TYPE *, const TYPE *, size_t);                                              \
+    typedef void (*FMA_##NAME)(TYPE *, const TYPE *, size_t, TYPE);                                        \
+                                                                                                           \
+    void fill##NAME(TYPE *x, TYPE *y, size_t n)                                                            \
+    {                                                                                                      \
+        for (size_t i = 0; i < n; i++)                                                                     \
+        {                                                                                                  \
+            x[i] = MAKE(i);                                                                                \
+            y[i] = MAKE(i * 7 + 3);                                                                        \
+        }                                                                                                  \
+    }                                                                                                      \
+                                                                                                           \
+    /* Runs kernel number k of one operation into out, using copies of x and y */                        \
+    void run##NAME(int operation, void *kernel, TYPE *x, TYPE *y, TYPE *out, size_t n, TYPE value)         \
+    {                                                                                                      \
+        TYPE *work = operation == 2 ? y : x;                                                               \
+        if (operation == 0)                                                                                \
+        {                                                                                                  \
+            ((SCALE_##NAME)kernel)(work, n, value);                                                        \
+        }                                                                                                  \
+        else if (operation == 1)                                                                           \
+        {                                                                                                  \
+            ((ADD_##NAME)kernel)(work, y, n);                                                              \
+        }                                                                                                  \
+        else                                                                                               \
+        {                                                                                                  \
+            ((FMA_##NAME)kernel)(work, x, n, value);                                                       \
+        }                                                                                                  \
+        memcpy(out, work, n * sizeof(TYPE));                                                               \
+    }                                                                                                      \
+                                                                                                           \
+    void test##NAME(const char *type, void *kernels[3][3], TYPE value)                                     \
+    {                                                                                                      \
+        const char *operations[] = {"scale", "add", "fma"};                                                \
+        const char *levels[] = {"scalar", "SSE", "AVX2"};                                                  \
+        int supported[] = {1, supportsSSE41, supportsAVX2};                                                \
+        size_t sizes[] = {CACHED_ELEMENTS, ELEMENTS};                                                      \
+        size_t bytes = (ELEMENTS + 64) * sizeof(TYPE);                                                     \
+        TYPE *x = (TYPE *)aligned_alloc(64, bytes), *y = (TYPE *)aligned_alloc(64, bytes);                 \
+        TYPE *expected = (TYPE *)aligned_alloc(64, bytes), *actual = (TYPE *)aligned_alloc(64, bytes);     \
+        for (int operation = 0; operation < 3; operation++)                                                \
+        {                                                                                                  \
+            double scalarNs[2] = {0, 0};                                                                   \
+            for (int level = 0; level < 3; level++)                                                        \
+            {                                                                                              \
+                void *kernel = kernels[operation][level];                                                  \
+                if (kernel == NULL || !supported[level])                                                   \
+                {                                                                                          \
+                    printf("%s\t%s\t%s\tn/a\n", type, operations[operation], levels[level]);               \
+                    continue;                                                                              \
+                }                                                                                          \
+                int mismatches = 0;                                                                        \
+                for (size_t offset = 0; offset < 2; offset++)                                              \
+                {                                                                                          \
+                    for (size_t n = 0; n < 80; n++)                                                        \
+                    {                                                                                      \
+                        fill##NAME(x + offset, y + offset, n);                                             \
+                        run##NAME(operation, kernels[operation][0], x + offset, y + offset, expected, n, value); \
+                        fill##NAME(x + offset, y + offset, n);                                             \
+                        run##NAME(operation, kernel, x + offset, y + offset, actual, n, value);            \
+                        mismatches += memcmp(expected, actual, n * sizeof(TYPE)) != 0;                    \
+                    }                                                                                      \
+                    fill##NAME(x + offset, y + offset, ELEMENTS);                                          \
+                    run##NAME(operation, kernels[operation][0], x + offset, y + offset, expected, ELEMENTS, value); \
+                    fill##NAME(x + offset, y + offset, ELEMENTS);                                          \
+                    run##NAME(operation, kernel, x + offset, y + offset, actual, ELEMENTS, value);         \
+                    mismatches += memcmp(expected, actual, ELEMENTS * sizeof(TYPE)) != 0;                  \
+                }                                                                                          \
+                                                                                                           \
+                /* Timing repeats the kernel on the same aligned arrays; values stay finite */             \
+                printf("%s\t%s\t%s", type, operations[operation], levels[level]);                          \
+                for (int s = 0; s < 2; s++)                                                                \
+                {                                                                                          \
+                    size_t size = sizes[s];                                                                \
+                    fill##NAME(x, y, size);                                                                \
+                    double best = 1e30;                                                                    \
+                    for (int r = 0; r < REPEAT; r++)                                                       \
+                    {                                                                                      \
+                        struct timespec start, end;                                                        \
+                        clock_gettime(CLOCK_MONOTONIC, &start);                                            \
+                        if (operation == 0)                                                                \
+                            ((SCALE_##NAME)kernel)(x, size, value);                                        \
+                        else if (operation == 1)                                                           \
+                            ((ADD_##NAME)kernel)(x, y, size);                                              \
+                        else                                                                               \
+                            ((FMA_##NAME)kernel)(y, x, size, value);                                       \
+                        clock_gettime(CLOCK_MONOTONIC, &end);                                              \
+                        double ms = elapsedMilliseconds(&start, &end);                                     \
+                        best = ms < best ? ms : best;                                                      \
+                        if (r % 8 == 7)                                                                    \
+                            fill##NAME(x, y, size);                                                        \
+                    }                                                                                      \
+                    if (level == 0)                                                                        \
+                    {                                                                                      \
+                        scalarNs[s] = best * 1e6 / size;                                                   \
+                    }                                                                                      \
+                    printf("\t%.3f\t%.1fx", best * 1e6 / size, scalarNs[s] * size / (best * 1e6));        \
+                }                                                                                          \
+                printf("\t%s\n", mismatches == 0 ? "identical" : "MISMATCH");                              \
+            }                                                                                              \
+        }                                                                                                  \
+        free(x);                                                                                           \
+        free(y);                                                                                           \
+        free(expected);                                                                                    \
+        free(actual);                                                                                      \
+    }
+
+#define MAKE_INT32(i) ((int32_t)((i) * 2654435761u))
+#define MAKE_FLOAT(i) ((float)((i) % 1000) * 0.37f - 150.0f)
+#define MAKE_DOUBLE(i) ((double)((i) % 1000) * 0.37 - 150.0)
+
+DEFINE_DRIVER(int32_t, Int32, MAKE_INT32)
+DEFINE_DRIVER(float, Float, MAKE_FLOAT)
+DEFINE_DRIVER(double, Double, MAKE_DOUBLE)
+
+int main()
+{
+    __builtin_cpu_init();
+    supportsAVX2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    supportsSSE41 = __builtin_cpu_supports("sse4.1");
+    supportsFMA = __builtin_cpu_supports("fma");
+
+    void *int32Kernels[3][3] = {{scaleInt32Scalar, scaleInt32SSE, scaleInt32AVX2},
+                                {addInt32Scalar, addInt32SSE, addInt32AVX2},
+                                {fmaInt32Scalar, fmaInt32SSE, fmaInt32AVX2}};
+    void *floatKernels[3][3] = {{scaleFloatScalar, scaleFloatSSE, scaleFloatAVX2},
+                                {addFloatScalar, addFloatSSE, addFloatAVX2},
+                                {fmaFloatScalar, NULL, fmaFloatAVX2}};
+    void *doubleKernels[3][3] = {{scaleDoubleScalar, scaleDoubleSSE, scaleDoubleAVX2},
+                                 {addDoubleScalar, addDoubleSSE, addDoubleAVX2},
+                                 {fmaDoubleScalar, NULL, fmaDoubleAVX2}};
+
+    printf("\t\t\t%d elements\t%d elements\n", CACHED_ELEMENTS, ELEMENTS);
+    printf("type\tkernel\tlevel\tns/elem\tspeedup\tns/elem\tspeedup\tresult\n");
+    testInt32("int32", int32Kernels, 3);
+    testFloat("float", floatKernels, 1.0001f);
+    testDouble("double", doubleKernels, 1.0001);
+    return 0;
+}
+
+/*The speedups vary a good deal from run to run, so the figures below are ranges over
+six runs on the test machine. They are not a promise. While the arrays stay in the cache,
+the AVX2 kernels for int32 and float ran between 2.9 and 9.9 times faster than the scalar
+loop. Add was the slowest, at 2.9 to 6.5 times, and one run saw 3.3 to 3.9 times for int32
+add and for every float kernel. So the fourfold gain is typical but not guaranteed. Double
+gained 2.1 to 3.3 times, since its registers hold half as many elements. At a million
+elements the arrays no longer fit in the second-level cache, and every kernel spends
+most of its time waiting for data. Scale still gained 2.2 to 7.2 times, since it reads
+and writes one array, but add and fma, which stream two arrays, gained only 1.1 to 3
+times. Wider registers cannot make memory any faster; fusing several passes over an
+array into one, so that it is read only once, is what helps at that size.*/
@@ -19,6 +19,12 @@ tion is based on the following code sequence:*/
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 void function2()
 {
     int *var1 = 123;
@@ -30,10 +36,12 @@ void function1()
     int *var3 = 542;
     function2();
 }
+void checkAverage();
 int main()
 {
     int var4;
     function1();
+    checkAverage();
 }
 
 /*As functions are called, their stack frames are pushed onto the stack and the stack grows
@@ -76,18 +84,130 @@ passed an array of integers and an integer representing the array’s size. Thre
 statements are used to display the parameter’s and the local variable’s addresses:
 */
 
+/*The elements are added up by sumInts. The sum starts at zero and is 64 bits wide. A 32-bit int overflows once the elements add up
+to more than about two billion, which a large array reaches easily, while a 64-bit sum of
+even 2^31 elements of the largest int cannot overflow, so the sum is exact.
+
+The loop adds eight elements per iteration with SSE2, which every x86-64 processor has.
+Each group of four ints is sign-extended into two registers of two 64-bit lanes, by
+pairing every element with a copy of its sign bits. The four registers are added into
+four separate accumulators, so each addition does not have to wait for the one before it
+to finish. They are combined once at the end, and the few elements left over are added
+one at a time:*/
+
+int64_t sumInts(const int *arr, int size)
+{
+    int64_t sum = 0;
+    int vectorEnd = 0;
+#ifdef __SSE2__
+    vectorEnd = size - size % 8;
+    __m128i accumulators[4] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+    for (int i = 0; i < vectorEnd; i += 8)
+    {
+        __m128i first = _mm_loadu_si128((const __m128i *)(arr + i));
+        __m128i second = _mm_loadu_si128((const __m128i *)(arr + i + 4));
+        __m128i firstSign = _mm_srai_epi32(first, 31);
+        __m128i secondSign = _mm_srai_epi32(second, 31);
+        accumulators[0] = _mm_add_epi64(accumulators[0], _mm_unpacklo_epi32(first, firstSign));
+        accumulators[1] = _mm_add_epi64(accumulators[1], _mm_unpackhi_epi32(first, firstSign));
+        accumulators[2] = _mm_add_epi64(accumulators[2], _mm_unpacklo_epi32(second, secondSign));
+        accumulators[3] = _mm_add_epi64(accumulators[3], _mm_unpackhi_epi32(second, secondSign));
+    }
+    __m128i total = _mm_add_epi64(_mm_add_epi64(accumulators[0], accumulators[1]),
+                                  _mm_add_epi64(accumulators[2], accumulators[3]));
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, total);
+    sum = lanes[0] + lanes[1];
+#endif
+    for (int i = vectorEnd; i < size; i++)
+    {
+        sum += arr[i];
+    }
+    return sum;
+}
+
 float average(int *arr, int size)
 {
-    int sum;
+    int64_t sum = sumInts(arr, size);
     printf("arr: %p\n", &arr);
     printf("size: %p\n", &size);
     printf("sum: %p\n", &sum);
+    return size > 0 ? (float)((double)sum / size) : 0.0f;
+}
+
+/*checkAverage compares sumInts with a plain 64-bit loop on every length up to 40, so that
+each number of leftover elements is covered, filled with small values, with INT_MAX and
+with INT_MIN. It then times sumInts and the plain loop on 64 million ints, 256 MB, far
+more than any cache holds, and reports the rate at which each reads memory:*/
 
+#define CHECK_LENGTH 40
+#define LARGE_ARRAY (64 << 20)
+
+int64_t sumReference(const int *arr, int size)
+{
+    int64_t sum = 0;
     for (int i = 0; i < size; i++)
     {
         sum += arr[i];
     }
-    return (sum * 1.0f) / size;
+    return sum;
+}
+
+double elapsedSeconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void checkAverage()
+{
+    int values[CHECK_LENGTH];
+    int fills[3] = {0, INT_MAX, INT_MIN};
+    int mismatches = 0;
+    for (int f = 0; f < 3; f++)
+    {
+        for (int size = 0; size <= CHECK_LENGTH; size++)
+        {
+            for (int i = 0; i < size; i++)
+            {
+                values[i] = f == 0 ? i * 7 - 100 : fills[f];
+            }
+            mismatches += sumInts(values, size) != sumReference(values, size);
+        }
+    }
+    printf("\nsumInts on lengths 0 to %d: %s\n", CHECK_LENGTH, mismatches == 0 ? "exact" : "MISMATCH");
+
+    int *large = (int *)malloc(LARGE_ARRAY * sizeof(int));
+    if (large == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < LARGE_ARRAY; i++)
+    {
+        large[i] = INT_MAX - i;
+    }
+    float mean = average(large, LARGE_ARRAY);
+    printf("average of %d ints: %.1f, exact %.1f\n", LARGE_ARRAY, mean,
+           (double)sumReference(large, LARGE_ARRAY) / LARGE_ARRAY);
+
+    struct timespec start, end;
+    double best[2] = {1e30, 1e30};
+    volatile int64_t sink = 0;
+    for (int r = 0; r < 5; r++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        sink += sumInts(large, LARGE_ARRAY);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double simd = elapsedSeconds(&start, &end);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        sink += sumReference(large, LARGE_ARRAY);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double plain = elapsedSeconds(&start, &end);
+        best[0] = simd < best[0] ? simd : best[0];
+        best[1] = plain < best[1] ? plain : best[1];
+    }
+    double bytes = (double)LARGE_ARRAY * sizeof(int);
+    printf("sumInts: %.1f GB/s, plain loop: %.1f GB/s\n", bytes / best[0] / 1e9, bytes / best[1] / 1e9);
+    free(large);
 }
 
 /*When executed, you get output similar to the following:
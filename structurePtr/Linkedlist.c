@@ -1,5 +1,10 @@
 // Linked list
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 /*We will illustrate each of these data structures using an employee structure. For example,
 a linked list consists of nodes connected to one another. Each node will hold user supplied data. The simple employee structure is listed below. The unsigned char data
 type is used for age, as this will be large enough to hold people’s ages:*/
@@ -78,3 +83,311 @@ typedef struct _linkedList
     Node *tail;
     Node *current;
 } LinkedList;
+
+/*Allocating Nodes from a Pool
+Every node added to a list needs memory, and the obvious approach calls malloc once per
+node and free once per node. For a list of ten million employees, that is ten million
+calls each way, and they dominate the time spent building and tearing the list down.
+
+Instead, nodes come from a node pool, following the idea in “Avoiding malloc/free
+Overhead.” The pool allocates nodes NODE_CHUNK at a time in one block, and keeps unused
+nodes on a free list threaded through their own next fields. Since a Node already has a
+next pointer, no extra field is needed:*/
+
+#define NODE_CHUNK 4096
+
+typedef struct _nodeChunk
+{
+    struct _nodeChunk *next;
+    Node nodes[NODE_CHUNK];
+} NodeChunk;
+
+typedef struct _nodePool
+{
+    Node *free;
+    NodeChunk *chunks;
+} NodePool;
+
+NodePool nodePool = {NULL, NULL};
+
+/*allocateNode takes a node off the free list. When the list is empty a new chunk is
+allocated and all of its nodes are linked onto the free list in address order, so
+consecutively allocated nodes are adjacent in memory:*/
+
+Node *allocateNode(NodePool *pool)
+{
+    if (pool->free == NULL)
+    {
+        NodeChunk *chunk = (NodeChunk *)malloc(sizeof(NodeChunk));
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+        for (int i = 0; i < NODE_CHUNK - 1; i++)
+        {
+            chunk->nodes[i].next = &chunk->nodes[i + 1];
+        }
+        chunk->nodes[NODE_CHUNK - 1].next = NULL;
+        pool->free = chunk->nodes;
+    }
+    Node *node = pool->free;
+    pool->free = node->next;
+    return node;
+}
+
+void releaseNode(NodePool *pool, Node *node)
+{
+    node->next = pool->free;
+    pool->free = node;
+}
+
+// The chunks themselves are only freed when the pool is destroyed, after every list using it:
+
+void destroyNodePool(NodePool *pool)
+{
+    while (pool->chunks != NULL)
+    {
+        NodeChunk *next = pool->chunks->next;
+        free(pool->chunks);
+        pool->chunks = next;
+    }
+    pool->free = NULL;
+}
+
+/*Before a linked list can be used it needs to be initialized. The initializeList function
+sets the list's three pointers to NULL:*/
+
+void initializeList(LinkedList *list)
+{
+    list->head = NULL;
+    list->tail = NULL;
+    list->current = NULL;
+}
+
+/*The addHead function adds data to the head of the list. A node is obtained from the pool
+and its data field is assigned the data passed. If the list is empty, the node becomes
+both the head and the tail. Otherwise it is linked in front of the current head. Like the
+other functions that add nodes, it returns 1 on success and 0, leaving the list unchanged,
+if no node could be allocated:*/
+
+int addHead(LinkedList *list, void *data)
+{
+    Node *node = allocateNode(&nodePool);
+    if (node == NULL)
+    {
+        return 0;
+    }
+    node->data = data;
+    if (list->head == NULL)
+    {
+        list->tail = node;
+        node->next = NULL;
+    }
+    else
+    {
+        node->next = list->head;
+    }
+    list->head = node;
+    return 1;
+}
+
+// The addTail function appends a node to the end of the list, using the tail pointer:
+
+int addTail(LinkedList *list, void *data)
+{
+    Node *node = allocateNode(&nodePool);
+    if (node == NULL)
+    {
+        return 0;
+    }
+    node->data = data;
+    node->next = NULL;
+    if (list->head == NULL)
+    {
+        list->head = node;
+    }
+    else
+    {
+        list->tail->next = node;
+    }
+    list->tail = node;
+    return 1;
+}
+
+/*The insertSorted function keeps the list ordered according to a COMPARE function. It
+walks the list until it finds the first node whose data follows the new data, and links
+the new node in front of it. Equal elements are inserted after the existing ones, so the
+insertion order of equal elements is preserved. Appending to the end is done in
+constant time, which makes building a list from data that is already sorted linear:*/
+
+int insertSorted(LinkedList *list, COMPARE compare, void *data)
+{
+    if (list->head == NULL || compare(data, list->head->data) < 0)
+    {
+        return addHead(list, data);
+    }
+    if (compare(data, list->tail->data) >= 0)
+    {
+        return addTail(list, data);
+    }
+    Node *previous = list->head;
+    while (compare(data, previous->next->data) >= 0)
+    {
+        previous = previous->next;
+    }
+    Node *node = allocateNode(&nodePool);
+    if (node == NULL)
+    {
+        return 0;
+    }
+    node->data = data;
+    node->next = previous->next;
+    previous->next = node;
+    return 1;
+}
+
+/*The getNode function finds the first node whose data matches the data passed, according
+to the COMPARE function. It returns NULL if there is no match:*/
+
+Node *getNode(LinkedList *list, COMPARE compare, void *data)
+{
+    Node *node = list->head;
+    while (node != NULL)
+    {
+        if (compare(node->data, data) == 0)
+        {
+            return node;
+        }
+        node = node->next;
+    }
+    return NULL;
+}
+
+/*The delete function removes a node from the list. Because the list is singly linked, the
+node before it has to be found first, and the tail is updated if the last node is the one
+removed. The node goes back to the pool; the data it pointed to still belongs to the
+caller:*/
+
+void delete(LinkedList *list, Node *node)
+{
+    if (node == list->head)
+    {
+        list->head = node->next;
+        if (list->head == NULL)
+        {
+            list->tail = NULL;
+        }
+    }
+    else
+    {
+        Node *previous = list->head;
+        while (previous != NULL && previous->next != node)
+        {
+            previous = previous->next;
+        }
+        if (previous == NULL)
+        {
+            return;
+        }
+        previous->next = node->next;
+        if (node == list->tail)
+        {
+            list->tail = previous;
+        }
+    }
+    if (list->current == node)
+    {
+        list->current = NULL;
+    }
+    releaseNode(&nodePool, node);
+}
+
+/*The traverse function visits each node in turn, starting at the head, and calls the
+DISPLAY function with its data. The list's current pointer follows the traversal. The
+displayLinkedList function prints the list that way:*/
+
+void traverse(LinkedList *list, DISPLAY visit)
+{
+    list->current = list->head;
+    while (list->current != NULL)
+    {
+        visit(list->current->data);
+        list->current = list->current->next;
+    }
+}
+
+void displayLinkedList(LinkedList *list, DISPLAY display)
+{
+    printf("\nLinked List\n");
+    traverse(list, display);
+}
+
+/*When a list is no longer needed, destroyList returns all of its nodes to the pool. The
+nodes are already linked together and the tail's next pointer is NULL, so the whole list
+can be spliced onto the front of the free list in constant time, however long it is:*/
+
+void destroyList(LinkedList *list)
+{
+    if (list->head != NULL)
+    {
+        list->tail->next = nodePool.free;
+        nodePool.free = list->head;
+    }
+    initializeList(list);
+}
+
+/*The following sequence builds a sorted list of employees, finds and deletes one of them,
+and displays the list. It then builds and destroys a list of ten million nodes to show
+the cost of the pool at that scale:*/
+
+#define LARGE_LIST 10000000
+
+int main()
+{
+    LinkedList linkedList;
+    Employee *samuel = (Employee *)malloc(sizeof(Employee));
+    strcpy(samuel->name, "Samuel");
+    samuel->age = 32;
+    Employee *sally = (Employee *)malloc(sizeof(Employee));
+    strcpy(sally->name, "Sally");
+    sally->age = 28;
+    Employee *susan = (Employee *)malloc(sizeof(Employee));
+    strcpy(susan->name, "Susan");
+    susan->age = 45;
+
+    initializeList(&linkedList);
+    insertSorted(&linkedList, (COMPARE)compareEmployee, susan);
+    insertSorted(&linkedList, (COMPARE)compareEmployee, samuel);
+    insertSorted(&linkedList, (COMPARE)compareEmployee, sally);
+    displayLinkedList(&linkedList, (DISPLAY)displayEmployee);
+
+    Node *node = getNode(&linkedList, (COMPARE)compareEmployee, sally);
+    delete(&linkedList, node);
+    displayLinkedList(&linkedList, (DISPLAY)displayEmployee);
+    destroyList(&linkedList);
+
+    struct timespec start, built, destroyed;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < LARGE_LIST; i++)
+    {
+        if (!addTail(&linkedList, samuel))
+        {
+            printf("out of memory after %ld nodes\n", i);
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &built);
+    destroyList(&linkedList);
+    clock_gettime(CLOCK_MONOTONIC, &destroyed);
+    printf("\nbuilt %d nodes in %.1f ms, destroyed in %.3f ms\n", LARGE_LIST,
+           (built.tv_sec - start.tv_sec) * 1e3 + (built.tv_nsec - start.tv_nsec) / 1e6,
+           (destroyed.tv_sec - built.tv_sec) * 1e3 + (destroyed.tv_nsec - built.tv_nsec) / 1e6);
+
+    destroyNodePool(&nodePool);
+    free(samuel);
+    free(sally);
+    free(susan);
+    return 0;
+}
@@ -0,0 +1,559 @@
+// A Balanced Search Tree of Employees
+
+/*A sorted linked list finds an employee by walking from the head, so every lookup and
+every sorted insertion takes time proportional to the number of employees. A binary
+search tree keeps the same order but halves the candidates at every step, as long as it
+stays balanced. An AVL tree guarantees this. Each node records its height, and after
+every insertion or deletion the heights of a node's two subtrees are not allowed to
+differ by more than one. When they would, one or two rotations restore the balance. The
+height of the tree is then at most about 1.44 log2 n, so insert, delete and find all take
+O(log n) steps whatever order the employees arrive in.
+
+The tree is ordered by a COMPARE function, the same one used by insertSorted in
+Linkedlist.c, and holds one node per distinct key.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+int compareEmployee(Employee *e1, Employee *e2)
+{
+    return strcmp(e1->name, e2->name);
+}
+
+void displayEmployee(Employee *employee)
+{
+    printf("%s\t%d\n", employee->name, employee->age);
+}
+
+typedef void (*DISPLAY)(void *);
+typedef int (*COMPARE)(void *, void *);
+
+typedef struct _treeNode
+{
+    void *data;
+    struct _treeNode *left;
+    struct _treeNode *right;
+    int height;
+} TreeNode;
+
+/*Allocating Nodes from an Arena
+Each tree owns an arena its nodes are carved from. The arena allocates blocks of nodes,
+each twice the size of the one before, and hands out nodes from the newest block in
+order. Deleted nodes go on a free list threaded through their left pointers and are
+reused first. Since the block sizes double, a tree of a million nodes needs about
+fourteen blocks, and destroying it frees those blocks without visiting a single node:*/
+
+#define FIRST_BLOCK 64
+
+typedef struct _nodeBlock
+{
+    struct _nodeBlock *next;
+    size_t capacity;
+    TreeNode nodes[];
+} NodeBlock;
+
+typedef struct _treeArena
+{
+    NodeBlock *blocks;
+    size_t used;
+    TreeNode *free;
+} TreeArena;
+
+TreeNode *allocateTreeNode(TreeArena *arena)
+{
+    if (arena->free != NULL)
+    {
+        TreeNode *node = arena->free;
+        arena->free = node->left;
+        return node;
+    }
+    if (arena->blocks == NULL || arena->used == arena->blocks->capacity)
+    {
+        size_t capacity = arena->blocks == NULL ? FIRST_BLOCK : arena->blocks->capacity * 2;
+        NodeBlock *block = (NodeBlock *)malloc(sizeof(NodeBlock) + capacity * sizeof(TreeNode));
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        block->next = arena->blocks;
+        block->capacity = capacity;
+        arena->blocks = block;
+        arena->used = 0;
+    }
+    return &arena->blocks->nodes[arena->used++];
+}
+
+void releaseTreeNode(TreeArena *arena, TreeNode *node)
+{
+    node->left = arena->free;
+    arena->free = node;
+}
+
+typedef struct _avlTree
+{
+    TreeNode *root;
+    COMPARE compare;
+    size_t count;
+    TreeArena arena;
+} AvlTree;
+
+void initializeTree(AvlTree *tree, COMPARE compare)
+{
+    tree->root = NULL;
+    tree->compare = compare;
+    tree->count = 0;
+    tree->arena.blocks = NULL;
+    tree->arena.used = 0;
+    tree->arena.free = NULL;
+}
+
+// destroyTree releases every node at once. The data still belongs to the caller:
+
+void destroyTree(AvlTree *tree)
+{
+    while (tree->arena.blocks != NULL)
+    {
+        NodeBlock *next = tree->arena.blocks->next;
+        free(tree->arena.blocks);
+        tree->arena.blocks = next;
+    }
+    initializeTree(tree, tree->compare);
+}
+
+/*Rotations
+An empty subtree has height zero. rebalance recomputes a node's height from its children
+and, if one side has become two levels taller than the other, rotates. When the taller
+child leans the other way, it is rotated first, which is the double rotation. rebalance
+returns the node now at the top of this subtree:*/
+
+int height(TreeNode *node)
+{
+    return node == NULL ? 0 : node->height;
+}
+
+void updateHeight(TreeNode *node)
+{
+    int left = height(node->left);
+    int right = height(node->right);
+    node->height = (left > right ? left : right) + 1;
+}
+
+TreeNode *rotateRight(TreeNode *node)
+{
+    TreeNode *top = node->left;
+    node->left = top->right;
+    top->right = node;
+    updateHeight(node);
+    updateHeight(top);
+    return top;
+}
+
+TreeNode *rotateLeft(TreeNode *node)
+{
+    TreeNode *top = node->right;
+    node->right = top->left;
+    top->left = node;
+    updateHeight(node);
+    updateHeight(top);
+    return top;
+}
+
+TreeNode *rebalance(TreeNode *node)
+{
+    updateHeight(node);
+    int balance = height(node->left) - height(node->right);
+    if (balance > 1)
+    {
+        if (height(node->left->left) < height(node->left->right))
+        {
+            node->left = rotateLeft(node->left);
+        }
+        return rotateRight(node);
+    }
+    if (balance < -1)
+    {
+        if (height(node->right->right) < height(node->right->left))
+        {
+            node->right = rotateRight(node->right);
+        }
+        return rotateLeft(node);
+    }
+    return node;
+}
+
+/*Insertion and Deletion
+Both descend recursively to the place of the key and rebalance every node on the way
+back up. The depth of the recursion is the height of the tree, which is small.
+
+insertTree returns 1 if the data was added, 0 if an element with an equal key is already
+in the tree, which is left unchanged, and -1 if no node could be allocated:*/
+
+TreeNode *insertNode(AvlTree *tree, TreeNode *node, void *data, int *result)
+{
+    if (node == NULL)
+    {
+        TreeNode *created = allocateTreeNode(&tree->arena);
+        if (created == NULL)
+        {
+            *result = -1;
+            return NULL;
+        }
+        created->data = data;
+        created->left = NULL;
+        created->right = NULL;
+        created->height = 1;
+        *result = 1;
+        return created;
+    }
+    int order = tree->compare(data, node->data);
+    if (order == 0)
+    {
+        *result = 0;
+        return node;
+    }
+    if (order < 0)
+    {
+        node->left = insertNode(tree, node->left, data, result);
+    }
+    else
+    {
+        node->right = insertNode(tree, node->right, data, result);
+    }
+    return *result == 1 ? rebalance(node) : node;
+}
+
+int insertTree(AvlTree *tree, void *data)
+{
+    int result = 0;
+    TreeNode *root = insertNode(tree, tree->root, data, &result);
+    if (result == 1)
+    {
+        tree->root = root;
+        tree->count++;
+    }
+    return result;
+}
+
+/*A node with two children cannot simply be removed. Its data is replaced with that of its
+successor, the smallest node of its right subtree, and the successor is removed instead.
+The successor has no left child, so that removal is easy. removeSmallest does it and
+hands back the detached node through its last argument:*/
+
+TreeNode *removeSmallest(TreeNode *node, TreeNode **smallest)
+{
+    if (node->left == NULL)
+    {
+        *smallest = node;
+        return node->right;
+    }
+    node->left = removeSmallest(node->left, smallest);
+    return rebalance(node);
+}
+
+TreeNode *deleteNode(AvlTree *tree, TreeNode *node, void *key, void **removed)
+{
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    int order = tree->compare(key, node->data);
+    if (order < 0)
+    {
+        node->left = deleteNode(tree, node->left, key, removed);
+    }
+    else if (order > 0)
+    {
+        node->right = deleteNode(tree, node->right, key, removed);
+    }
+    else
+    {
+        *removed = node->data;
+        if (node->left == NULL || node->right == NULL)
+        {
+            TreeNode *child = node->left != NULL ? node->left : node->right;
+            releaseTreeNode(&tree->arena, node);
+            return child;
+        }
+        TreeNode *successor;
+        node->right = removeSmallest(node->right, &successor);
+        node->data = successor->data;
+        releaseTreeNode(&tree->arena, successor);
+    }
+    return *removed != NULL ? rebalance(node) : node;
+}
+
+// deleteTree returns the data removed, or NULL if no element matched the key:
+
+void *deleteTree(AvlTree *tree, void *key)
+{
+    void *removed = NULL;
+    tree->root = deleteNode(tree, tree->root, key, &removed);
+    if (removed != NULL)
+    {
+        tree->count--;
+    }
+    return removed;
+}
+
+void *findTree(AvlTree *tree, void *key)
+{
+    TreeNode *node = tree->root;
+    while (node != NULL)
+    {
+        int order = tree->compare(key, node->data);
+        if (order == 0)
+        {
+            return node->data;
+        }
+        node = order < 0 ? node->left : node->right;
+    }
+    return NULL;
+}
+
+/*Iteration
+A TreeIterator walks the tree in order without parent pointers. It keeps the path of
+nodes still to be visited on a small stack: the next node is on top, and below it are
+the ancestors whose left subtree is being visited. An AVL tree of 2^64 nodes would be
+less than 93 levels high, so the stack has a fixed size:*/
+
+#define MAX_TREE_HEIGHT 96
+
+typedef struct _treeIterator
+{
+    TreeNode *stack[MAX_TREE_HEIGHT];
+    int depth;
+} TreeIterator;
+
+void pushLeftPath(TreeIterator *iterator, TreeNode *node)
+{
+    while (node != NULL)
+    {
+        iterator->stack[iterator->depth++] = node;
+        node = node->left;
+    }
+}
+
+void firstTree(AvlTree *tree, TreeIterator *iterator)
+{
+    iterator->depth = 0;
+    pushLeftPath(iterator, tree->root);
+}
+
+// nextTree returns the next element in order, or NULL when there are no more:
+
+void *nextTree(TreeIterator *iterator)
+{
+    if (iterator->depth == 0)
+    {
+        return NULL;
+    }
+    TreeNode *node = iterator->stack[--iterator->depth];
+    pushLeftPath(iterator, node->right);
+    return node->data;
+}
+
+/*lowerBound positions an iterator at the first element not less than the key, and
+upperBound at the first element greater than it. Both descend once from the root. A node
+that qualifies is pushed before going left to look for an earlier one, exactly as
+pushLeftPath would have left it; a node that does not is skipped by going right. The
+elements from lowerBound up to upperBound are those equal to the key, and iterating from
+lowerBound(a) until an element reaches b gives a range query:*/
+
+void seekTree(AvlTree *tree, void *key, TreeIterator *iterator, int inclusive)
+{
+    iterator->depth = 0;
+    TreeNode *node = tree->root;
+    while (node != NULL)
+    {
+        int order = tree->compare(node->data, key);
+        if (order > 0 || (inclusive && order == 0))
+        {
+            iterator->stack[iterator->depth++] = node;
+            node = node->left;
+        }
+        else
+        {
+            node = node->right;
+        }
+    }
+}
+
+void lowerBound(AvlTree *tree, void *key, TreeIterator *iterator)
+{
+    seekTree(tree, key, iterator, 1);
+}
+
+void upperBound(AvlTree *tree, void *key, TreeIterator *iterator)
+{
+    seekTree(tree, key, iterator, 0);
+}
+
+void traverseTree(AvlTree *tree, DISPLAY display)
+{
+    TreeIterator iterator;
+    firstTree(tree, &iterator);
+    void *data;
+    while ((data = nextTree(&iterator)) != NULL)
+    {
+        display(data);
+    }
+}
+
+/*checkTree verifies the invariants: the order of the keys, the recorded heights, and the
+balance of every node. It returns the height of the subtree, or -1 if anything is wrong:*/
+
+int checkTree(AvlTree *tree, TreeNode *node)
+{
+    if (node == NULL)
+    {
+        return 0;
+    }
+    int left = checkTree(tree, node->left);
+    int right = checkTree(tree, node->right);
+    if (left < 0 || right < 0 || left - right > 1 || right - left > 1 ||
+        node->height != (left > right ? left : right) + 1 ||
+        (node->left != NULL && tree->compare(node->left->data, node->data) >= 0) ||
+        (node->right != NULL && tree->compare(node->right->data, node->data) <= 0))
+    {
+        return -1;
+    }
+    return node->height;
+}
+
+/*The program builds a small directory and runs bound queries on it, then times a million
+insertions, lookups and deletions in random order, checking the tree's invariants along
+the way, and finally times destroying a full tree:*/
+
+#define EMPLOYEES 1000000
+
+double elapsedMilliseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int main()
+{
+    Employee directory[] = {{"Samuel", 32}, {"Sally", 28}, {"Susan", 45}, {"Sam", 51}, {"Tom", 40}};
+    AvlTree tree;
+    initializeTree(&tree, (COMPARE)compareEmployee);
+    for (int i = 0; i < 5; i++)
+    {
+        insertTree(&tree, &directory[i]);
+    }
+    printf("\nTree\n");
+    traverseTree(&tree, (DISPLAY)displayEmployee);
+
+    Employee from = {"Sally", 0}, to = {"Susan", 0};
+    TreeIterator iterator;
+    lowerBound(&tree, &from, &iterator);
+    printf("\nFrom Sally up to Susan\n");
+    Employee *employee;
+    while ((employee = (Employee *)nextTree(&iterator)) != NULL && compareEmployee(employee, &to) < 0)
+    {
+        displayEmployee(employee);
+    }
+    upperBound(&tree, &from, &iterator);
+    printf("\nFirst after Sally: %s\n", ((Employee *)nextTree(&iterator))->name);
+    destroyTree(&tree);
+
+    Employee *employees = (Employee *)malloc(EMPLOYEES * sizeof(Employee));
+    for (long i = 0; i < EMPLOYEES; i++)
+    {
+        snprintf(employees[i].name, sizeof(employees[i].name), "employee%08ld", i);
+        employees[i].age = (unsigned char)(18 + i % 50);
+    }
+    long *order = (long *)malloc(EMPLOYEES * sizeof(long));
+    for (long i = 0; i < EMPLOYEES; i++)
+    {
+        order[i] = i;
+    }
+    unsigned long state = 17;
+    for (long i = EMPLOYEES - 1; i > 0; i--)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        long j = (long)((state >> 33) % (unsigned long)(i + 1));
+        long swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    struct timespec start, end;
+    int errors = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < EMPLOYEES; i++)
+    {
+        errors += insertTree(&tree, &employees[order[i]]) != 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double insertMs = elapsedMilliseconds(&start, &end);
+    int treeHeight = checkTree(&tree, tree.root);
+    errors += treeHeight < 0;
+
+    // In-order iteration must visit the employees in name order, which is index order here
+    long position = 0;
+    firstTree(&tree, &iterator);
+    while ((employee = (Employee *)nextTree(&iterator)) != NULL)
+    {
+        errors += employee != &employees[position++];
+    }
+    errors += position != EMPLOYEES;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < EMPLOYEES; i++)
+    {
+        errors += findTree(&tree, &employees[i]) != &employees[i];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double findMs = elapsedMilliseconds(&start, &end);
+
+    // Delete every other employee, then check the bounds skip over the gaps
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < EMPLOYEES; i++)
+    {
+        if (order[i] % 2 == 1)
+        {
+            errors += deleteTree(&tree, &employees[order[i]]) != &employees[order[i]];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double deleteMs = elapsedMilliseconds(&start, &end);
+    errors += checkTree(&tree, tree.root) < 0 || tree.count != EMPLOYEES / 2;
+    for (long i = 1; i + 1 < EMPLOYEES; i += 2)
+    {
+        lowerBound(&tree, &employees[i], &iterator);
+        errors += nextTree(&iterator) != &employees[i + 1];
+        upperBound(&tree, &employees[i + 1], &iterator);
+        errors += nextTree(&iterator) != (i + 3 < EMPLOYEES ? &employees[i + 3] : NULL);
+    }
+
+    for (long i = 1; i < EMPLOYEES; i += 2)
+    {
+        insertTree(&tree, &employees[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    destroyTree(&tree);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double destroyMs = elapsedMilliseconds(&start, &end);
+
+    printf("\n%d employees, height %d, %d errors\n", EMPLOYEES, treeHeight, errors);
+    printf("insert\t%.0f ns\nfind\t%.0f ns\ndelete\t%.0f ns\n", insertMs * 1e6 / EMPLOYEES, findMs * 1e6 / EMPLOYEES,
+           deleteMs * 2e6 / EMPLOYEES);
+    printf("destroy\t%.3f ms for the whole tree\n", destroyMs);
+
+    free(order);
+    free(employees);
+    return 0;
+}
+
+/*The height stays close to log2 of the number of employees, so every operation visits
+only about twenty nodes. Most of their cost is cache misses on nodes and on the employees
+being compared. Reinserting after the deletions reuses the freed nodes, and destroying
+the tree returns a few large blocks to the system instead of a million small ones.*/
@@ -9,88 +9,540 @@ pool, a new instance is dynamically allocated. This approach effectively maintai
 of structures that can be used and reused as needed.
 */
 /*To demonstrate this approach we will use the Person structure previously defined. A
-pool of persons is maintained in an array. A more complex list, such as a linked list, can
-also be used, as illustrated in the section “Single-Linked List” on page 142. To keep this
-example simple, an array of pointers is used, as declared below:*/
+pool of persons could be maintained in an array of pointers, but then every get and
+every return has to scan the array looking for a NULL or non-NULL slot. Instead we keep
+the pool as a single-linked list, as illustrated in the section “Single-Linked List” on
+page 142, with one twist: the list is embedded in the free objects themselves. While an
+object sits in the pool nobody is using its fields, so its first bytes can hold the pointer
+to the next free object. Getting and returning an object are then a pop and a push on
+the head of that list, and both take constant time no matter how large the pool is:*/
+#include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 #define LIST_SIZE 10
+#define LIST_MAX_SIZE 4096
+#define EPOCH_LENGTH 1024
+#define DECAY_SHIFT 1
+
+// Compile with -DPOOL_STATS=1 to add counters and checkout timestamps to the pool
+#ifndef POOL_STATS
+#define POOL_STATS 0
+#endif
+#define POOL_STAT_SLOTS 16
+#define RESIDENCY_BUCKETS 32
 
 typedef struct person
 {
     int a;
     char b;
 } Person;
-Person *list[LIST_SIZE];
 
-/*Before the list can be used, it needs to be initialized. The following function assigns NULL
-to each element of the array:
-*/
-void initializeList()
+/*A free object is viewed through the PoolNode type. It only has a next pointer, so any
+object at least as large as a pointer can be threaded onto the list. Smaller types are
+rounded up when the pool is created:*/
+
+typedef struct _poolNode
+{
+    struct _poolNode *next;
+} PoolNode;
+
+/*A pool we cannot observe is a pool we cannot tune. With POOL_STATS enabled, each pool
+counts hits, the gets served from the list, misses, the gets that fell through to
+malloc, and overflows, the returns that were freed because the pool was full. It also
+records how long each object stayed checked out, in a histogram whose bucket i counts the
+checkouts that lasted from 2^i to 2^(i+1) - 1 nanoseconds.
+
+These counters are updated on every call, so if several threads shared one set, every
+update would bounce the same cache line between their cores. Instead each pool has
+POOL_STAT_SLOTS sets of counters and every thread updates mostly its own slot. Each slot
+is aligned to a 64-byte cache line so that two slots never share one.
+
+The statistics cost time on every call, two clock_gettime calls per checkout in
+particular, so they are compiled in only when POOL_STATS is set to 1:*/
+
+typedef struct _poolCounters
+{
+    _Alignas(64) atomic_uint_fast64_t hits;
+    atomic_uint_fast64_t misses;
+    atomic_uint_fast64_t returns;
+    atomic_uint_fast64_t overflows;
+    atomic_uint_fast64_t residency[RESIDENCY_BUCKETS];
+} PoolCounters;
+
+/*To time a checkout, a small header holding the checkout time is placed in front of every
+object. The caller never sees it: allocateObject returns the address just past the
+header, and freeObject steps back to the start of the block before freeing it:*/
+
+#if POOL_STATS
+typedef union _poolHeader
+{
+    uint64_t checkedOut;
+    max_align_t align;
+} PoolHeader;
+#define POOL_HEADER_SIZE sizeof(PoolHeader)
+#define OBJECT_HEADER(object) ((PoolHeader *)((char *)(object) - POOL_HEADER_SIZE))
+#else
+#define POOL_HEADER_SIZE 0
+#endif
+
+/*The Pool structure holds the head of the free list along with the size of the objects it
+manages. The count field tracks how many objects are on the list, and capacity limits
+how many are kept. Nothing in the pool depends on Person, so one Pool can be created
+for each structure type that is allocated and freed frequently.
+
+A fixed capacity is a guess, and as the end of this section explains, it is usually the
+wrong one. Instead the capacity moves between a low and a high watermark based on what
+the pool observes. Time is divided into epochs of at least epochLength calls to poolGet.
+During an epoch the pool counts its misses, the gets that found the list empty, and remembers
+minCount, the fewest objects the list held at any point. The remaining fields configure
+how fast the pool shrinks:*/
+
+typedef struct _pool
+{
+    PoolNode *head;
+    size_t objectSize;
+    size_t count;
+    size_t capacity;
+    size_t lowWatermark;
+    size_t highWatermark;
+    size_t epochLength;
+    unsigned int decayShift;
+    size_t operations;
+    size_t misses;
+    size_t minCount;
+#if POOL_STATS
+    size_t peakCount;
+    PoolCounters counters[POOL_STAT_SLOTS];
+#endif
+} Pool;
+
+void *allocateObject(Pool *pool)
 {
-    for (int i = 0; i < LIST_SIZE; i++)
+    char *block = (char *)malloc(POOL_HEADER_SIZE + pool->objectSize);
+    return block != NULL ? block + POOL_HEADER_SIZE : NULL;
+}
+
+void freeObject(void *object)
+{
+    free((char *)object - POOL_HEADER_SIZE);
+}
+
+#if POOL_STATS
+/*A thread is given its slot the first time it touches any pool, by taking the next value
+of a shared counter. With more than POOL_STAT_SLOTS threads some slots are shared, so the
+counters are atomic. A relaxed add is all a counter needs. While a slot has a single
+owner its cache line stays in that core's cache, and the add costs little more than a
+plain increment:*/
+
+static atomic_uint nextStatSlot;
+static _Thread_local int statSlot = -1;
+
+PoolCounters *threadCounters(Pool *pool)
+{
+    if (statSlot < 0)
     {
-        list[i] = NULL;
+        statSlot = atomic_fetch_add(&nextStatSlot, 1) % POOL_STAT_SLOTS;
     }
+    return &pool->counters[statSlot];
 }
 
-/*Two functions are used to add and retrieve persons. The first is the getPerson function,
-as shown below. This function retrieves a person from the list if possible. The array’s
-elements are compared to NULL. The first non-null element is returned, and its position
-in list is then assigned a value of NULL. If there is no person available, then a new
-instance of a Person is created and returned. This avoids the overhead of dynamically
-allocating memory for a person every time a new one is needed. We only allocate mem‐
-ory if there is none in the pool. The initialization of the instance returned can be done
-either before it is returned or by the caller, depending on the needs of the application:
-*/
+void countEvent(atomic_uint_fast64_t *counter)
+{
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
 
-Person *getPerson()
+uint64_t readCounter(atomic_uint_fast64_t *counter)
+{
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+uint64_t nowNanoseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+void recordResidency(PoolCounters *counters, void *object)
 {
-    for (int i = 0; i < LIST_SIZE; i++)
+    uint64_t elapsed = nowNanoseconds() - OBJECT_HEADER(object)->checkedOut;
+    int bucket = elapsed == 0 ? 0 : 63 - __builtin_clzll(elapsed);
+    if (bucket >= RESIDENCY_BUCKETS)
     {
-        if (list[i] != NULL)
+        bucket = RESIDENCY_BUCKETS - 1;
+    }
+    countEvent(&counters->residency[bucket]);
+}
+#endif
+
+void initializePool(Pool *pool, size_t objectSize, size_t lowWatermark, size_t highWatermark)
+{
+    pool->head = NULL;
+    pool->objectSize = objectSize < sizeof(PoolNode) ? sizeof(PoolNode) : objectSize;
+    pool->count = 0;
+    pool->capacity = lowWatermark;
+    pool->lowWatermark = lowWatermark;
+    pool->highWatermark = highWatermark < lowWatermark ? lowWatermark : highWatermark;
+    pool->epochLength = EPOCH_LENGTH;
+    pool->decayShift = DECAY_SHIFT;
+    pool->operations = 0;
+    pool->misses = 0;
+    pool->minCount = 0;
+#if POOL_STATS
+    pool->peakCount = 0;
+    for (int i = 0; i < POOL_STAT_SLOTS; i++)
+    {
+        PoolCounters *slot = &pool->counters[i];
+        atomic_init(&slot->hits, 0);
+        atomic_init(&slot->misses, 0);
+        atomic_init(&slot->returns, 0);
+        atomic_init(&slot->overflows, 0);
+        for (int b = 0; b < RESIDENCY_BUCKETS; b++)
         {
-            Person *ptr = list[i];
-            list[i] = NULL;
+            atomic_init(&slot->residency[b], 0);
         }
     }
-    Person *person = (Person *)malloc(sizeof(Person));
-    return person;
+#endif
 }
-/*The second function is the returnPerson, which either adds the person to the list or
-frees it up. The array’s elements are checked to see whether there are any NULL values.
-If it does, then person is added to that position and the pointer is returned. If the list is
-full, then the pointers within person are freed using the deallocatePerson function,
-person is freed, and then NULL is returned:*/
 
-Person *returnPerson(Person *person)
+/*Growth happens immediately. Every miss is a malloc the pool could have avoided, so
+poolGet raises the capacity by one for each miss, up to the high watermark. The objects
+allocated during a burst are then kept when they are returned, and the next burst of the
+same size is served from the list.
+
+Shrinking happens at the end of each epoch in the poolDecay function. If the epoch had no
+misses, the pool looks at minCount. Those objects sat on the list for the whole epoch
+without being needed, so they are surplus. A share of them, half with the default
+decayShift of 1, is freed and the capacity drops by the same amount, but never below the
+low watermark. Releasing only a share lets the pool decay gradually over several
+quiet epochs rather than collapsing after one.
+
+minCount only means something if the epoch covers a whole cycle of use. A program that
+takes 16384 objects and then returns them all needs 16384 gets to empty the list, and an
+epoch of 1024 gets in the middle of that sees thousands of objects still waiting on the
+list. Those objects look idle but will be handed out later in the same cycle. So an
+epoch also lasts at least as many gets as the pool's capacity. Any working set the pool
+has grown to hold then empties the list at least once per epoch, and minCount drops to
+zero. Applications whose load can stop entirely
+should also call poolDecay from a timer or idle loop, since epochs only advance on poolGet:*/
+
+void poolDecay(Pool *pool)
+{
+    if (pool->misses == 0)
+    {
+        size_t surplus = pool->minCount >> pool->decayShift;
+        if (surplus == 0 && pool->minCount > 0)
+        {
+            surplus = 1;
+        }
+        size_t room = pool->capacity - pool->lowWatermark;
+        if (surplus > room)
+        {
+            surplus = room;
+        }
+        pool->capacity -= surplus;
+        while (pool->count > pool->capacity)
+        {
+            PoolNode *node = pool->head;
+            pool->head = node->next;
+            pool->count--;
+            freeObject(node);
+        }
+    }
+    pool->operations = 0;
+    pool->misses = 0;
+    pool->minCount = pool->count;
+}
+
+/*Freeing the surplus hands it back to malloc, not to the operating system. glibc keeps
+freed memory in its own free lists, and malloc_trim returns what it can to the system.
+A trim walks the whole heap under the allocator's lock, which would stall whichever
+poolGet happened to end an epoch, so poolDecay never calls it. An application that wants
+the memory back calls poolTrim from the same timer or idle loop instead:*/
+
+void poolTrim(Pool *pool)
+{
+    poolDecay(pool);
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+/*The poolGet function pops the first object off the free list and returns it. If the list is
+empty, a new instance is allocated and the miss is counted. The initialization of the
+instance returned can be done either before it is returned or by the caller, depending
+on the needs of the application:*/
+
+void *poolGet(Pool *pool)
+{
+    if (++pool->operations >= pool->epochLength && pool->operations >= pool->capacity)
+    {
+        poolDecay(pool);
+    }
+    void *object;
+    PoolNode *node = pool->head;
+    if (node != NULL)
+    {
+        pool->head = node->next;
+        pool->count--;
+        if (pool->count < pool->minCount)
+        {
+            pool->minCount = pool->count;
+        }
+        object = node;
+    }
+    else
+    {
+        object = allocateObject(pool);
+        if (object == NULL)
+        {
+            return NULL;
+        }
+        pool->misses++;
+        if (pool->capacity < pool->highWatermark)
+        {
+            pool->capacity++;
+        }
+    }
+#if POOL_STATS
+    PoolCounters *counters = threadCounters(pool);
+    if (node != NULL)
+    {
+        countEvent(&counters->hits);
+    }
+    else
+    {
+        countEvent(&counters->misses);
+    }
+    OBJECT_HEADER(object)->checkedOut = nowNanoseconds();
+#endif
+    return object;
+}
+
+/*The poolReturn function pushes the object onto the free list and returns it. If the pool
+already holds capacity objects, the object is freed and NULL is returned so the caller
+knows it no longer owns valid memory:*/
+
+void *poolReturn(Pool *pool, void *object)
 {
-    for (int i = 0; i < LIST_SIZE; i++)
+#if POOL_STATS
+    PoolCounters *counters = threadCounters(pool);
+    countEvent(&counters->returns);
+    recordResidency(counters, object);
+#endif
+    if (pool->count < pool->capacity)
     {
-        if (list[i] = NULL)
+        PoolNode *node = (PoolNode *)object;
+        node->next = pool->head;
+        pool->head = node;
+        pool->count++;
+#if POOL_STATS
+        if (pool->count > pool->peakCount)
         {
-            list[i] = person;
-            return person;
+            pool->peakCount = pool->count;
         }
+#endif
+        return object;
     }
-    deallocatePerson(person);
-    free(person);
+#if POOL_STATS
+    countEvent(&counters->overflows);
+#endif
+    freeObject(object);
     return NULL;
 }
-// The following illustrates the initialization of the list and adding a person to the list:
 
-main()
+// When the pool is no longer needed, every object still on the free list is released:
+
+void destroyPool(Pool *pool)
+{
+    PoolNode *node = pool->head;
+    while (node != NULL)
+    {
+        PoolNode *next = node->next;
+        freeObject(node);
+        node = next;
+    }
+    pool->head = NULL;
+    pool->count = 0;
+    pool->minCount = 0;
+}
+
+#if POOL_STATS
+/*The poolStats function adds up the slots and prints the totals, either as aligned text
+for a person to read or as a single JSON object for a monitoring system to collect.
+Empty histogram buckets are skipped in the text form. The totals are read without
+stopping the other threads, so a dump taken while the pool is busy is a close snapshot
+rather than an exact one:*/
+
+#define POOL_STATS_TEXT 0
+#define POOL_STATS_JSON 1
+
+void poolStats(Pool *pool, FILE *stream, int format)
+{
+    struct
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t returns;
+        uint64_t overflows;
+        uint64_t residency[RESIDENCY_BUCKETS];
+    } total = {0};
+    for (int i = 0; i < POOL_STAT_SLOTS; i++)
+    {
+        PoolCounters *slot = &pool->counters[i];
+        total.hits += readCounter(&slot->hits);
+        total.misses += readCounter(&slot->misses);
+        total.returns += readCounter(&slot->returns);
+        total.overflows += readCounter(&slot->overflows);
+        for (int b = 0; b < RESIDENCY_BUCKETS; b++)
+        {
+            total.residency[b] += readCounter(&slot->residency[b]);
+        }
+    }
+
+    if (format == POOL_STATS_JSON)
+    {
+        fprintf(stream, "{\"hits\": %llu, \"misses\": %llu, \"returns\": %llu, \"overflows\": %llu, "
+                        "\"size\": %zu, \"peakSize\": %zu, \"capacity\": %zu, \"residencyNs\": [",
+                (unsigned long long)total.hits, (unsigned long long)total.misses,
+                (unsigned long long)total.returns, (unsigned long long)total.overflows,
+                pool->count, pool->peakCount, pool->capacity);
+        for (int b = 0; b < RESIDENCY_BUCKETS; b++)
+        {
+            fprintf(stream, "%s%llu", b > 0 ? ", " : "", (unsigned long long)total.residency[b]);
+        }
+        fprintf(stream, "]}\n");
+        return;
+    }
+
+    uint64_t gets = total.hits + total.misses;
+    fprintf(stream, "hits:      %llu (%.1f%%)\n", (unsigned long long)total.hits,
+            gets > 0 ? 100.0 * total.hits / gets : 0.0);
+    fprintf(stream, "misses:    %llu\n", (unsigned long long)total.misses);
+    fprintf(stream, "returns:   %llu\n", (unsigned long long)total.returns);
+    fprintf(stream, "overflows: %llu\n", (unsigned long long)total.overflows);
+    fprintf(stream, "size:      %zu (peak %zu, capacity %zu)\n", pool->count, pool->peakCount, pool->capacity);
+    fprintf(stream, "checked out for:\n");
+    for (int b = 0; b < RESIDENCY_BUCKETS; b++)
+    {
+        if (total.residency[b] > 0)
+        {
+            fprintf(stream, "  >= %llu ns: %llu\n", 1ull << b, (unsigned long long)total.residency[b]);
+        }
+    }
+}
+#endif
+
+/*The getPerson and returnPerson functions are now thin wrappers around a pool of
+persons. The initializeList function creates that pool, starting with room for LIST_SIZE
+persons and allowing it to grow to LIST_MAX_SIZE. Person holds no pointers of its own, so
+there is nothing to deallocate before a surplus person is freed:*/
+
+Pool personPool;
+
+void initializeList()
+{
+    initializePool(&personPool, sizeof(Person), LIST_SIZE, LIST_MAX_SIZE);
+}
+
+Person *getPerson()
+{
+    return (Person *)poolGet(&personPool);
+}
+
+Person *returnPerson(Person *person)
+{
+    return (Person *)poolReturn(&personPool, person);
+}
+
+/*The following illustrates the initialization of the list and adding a person to the list.
+Programs that include this file to use the pool define POOL_NO_MAIN to leave it out:*/
+
+#ifndef POOL_NO_MAIN
+int main()
 {
     initializeList();
     Person *ptrPerson;
 
     ptrPerson = getPerson();
-    initializePerosn(ptrPerson, "ralph", "fitsgersad", "Mr.", 35);
-    displayPerson(*ptrPerson);
+    ptrPerson->a = 35;
+    ptrPerson->b = 'r';
+    printf("%d %c\n", ptrPerson->a, ptrPerson->b);
     returnPerson(ptrPerson);
+
+    // The second request is satisfied from the pool and receives the same address
+    Person *again = getPerson();
+    printf("%p %p\n", (void *)ptrPerson, (void *)again);
+    returnPerson(again);
+
+    // A burst of 100 persons misses the pool, so the pool grows to keep them when they return
+    Person *burst[100];
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            burst[i] = getPerson();
+        }
+        for (int i = 0; i < 100; i++)
+        {
+            returnPerson(burst[i]);
+        }
+        poolDecay(&personPool);
+        printf("after burst %d: capacity %zu, pooled %zu\n", round, personPool.capacity, personPool.count);
+    }
+
+    // Once the load goes away, each idle epoch releases half of the unused persons
+    for (int epoch = 0; epoch < 4; epoch++)
+    {
+        poolDecay(&personPool);
+        printf("after idle epoch %d: capacity %zu, pooled %zu\n", epoch, personPool.capacity, personPool.count);
+    }
+    poolTrim(&personPool);
+
+    // A working set four epochs long is only allocated in the first round; later rounds never miss
+    size_t workingSet = 4 * EPOCH_LENGTH;
+    Pool large;
+    initializePool(&large, sizeof(Person), 0, workingSet);
+    void **objects = (void **)malloc(workingSet * sizeof(void *));
+    size_t steadyMisses = 0;
+    size_t overflows = 0;
+    for (int round = 0; round < 20; round++)
+    {
+        for (size_t i = 0; i < workingSet; i++)
+        {
+            steadyMisses += round > 0 && large.count == 0;
+            objects[i] = poolGet(&large);
+        }
+        for (size_t i = 0; i < workingSet; i++)
+        {
+            overflows += poolReturn(&large, objects[i]) == NULL;
+        }
+    }
+    printf("working set %zu: capacity %zu, steady-state misses %zu, overflows %zu\n", workingSet,
+           large.capacity, steadyMisses, overflows);
+    free(objects);
+    destroyPool(&large);
+
+#if POOL_STATS
+    poolStats(&personPool, stdout, POOL_STATS_TEXT);
+    poolStats(&personPool, stdout, POOL_STATS_JSON);
+#endif
+
+    destroyPool(&personPool);
+    return 0;
 }
+#endif
 
 /*One problem associated with this approach deals with the list size. If the list is too small,
 then more dynamic allocation and deallocation of memory will be necessary. If the list
 is large and the structures are not being used, a potentially large amount of memory
 may be tied up and unavailable for other uses. A more sophisticated list management
-scheme can be used to manage the list’s size*/
\ No newline at end of file
+scheme can be used to manage the list’s size. The watermarks and poolDecay above are
+one such scheme: LIST_SIZE is now only the starting point and the floor, and the pool
+follows the load between it and LIST_MAX_SIZE*/
@@ -0,0 +1,550 @@
+// Doubly Linked and Circular Lists
+
+/*The single-linked list in Linkedlist.c can only be walked forward. Removing a node means
+finding the node in front of it first, so deleting the tail, or any node the caller
+already holds, takes time proportional to the length of the list.
+
+A doubly linked list gives each node a second link, pointing back to the node before it.
+With both neighbours at hand, a node can be unlinked in constant time: the node before
+it is pointed past it, and the node after it is pointed back past it. The list can also
+be walked in either direction. This is what a least-recently-used cache needs, where an
+entry that is used is moved to the front and the entry at the back is the one evicted.
+
+A circular list has no ends. Its last node links back to the first, and the first back to
+the last. The version here keeps one extra node, the sentinel, that holds no data and
+always sits between the last node and the first. Every real node then has a real node
+or the sentinel on both sides, so adding and removing never have to check for an empty
+list or update a head or tail pointer. Moving the sentinel rotates the list, which suits
+round-robin queues.
+
+Both variants use the same Employee, COMPARE, and DISPLAY definitions as Linkedlist.c,
+and take their nodes from a pool in the same way:*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+int compareEmployee(Employee *e1, Employee *e2)
+{
+    return strcmp(e1->name, e2->name);
+}
+
+void displayEmployee(Employee *employee)
+{
+    printf("%s\t%d\n", employee->name, employee->age);
+}
+
+typedef void (*DISPLAY)(void *);
+typedef int (*COMPARE)(void *, void *);
+
+typedef struct _doubleNode
+{
+    void *data;
+    struct _doubleNode *next;
+    struct _doubleNode *previous;
+} DoubleNode;
+
+/*The pool allocates nodes NODE_CHUNK at a time and keeps unused nodes on a free list
+threaded through their next fields, as in Linkedlist.c:*/
+
+#define NODE_CHUNK 4096
+
+typedef struct _nodeChunk
+{
+    struct _nodeChunk *next;
+    DoubleNode nodes[NODE_CHUNK];
+} NodeChunk;
+
+typedef struct _nodePool
+{
+    DoubleNode *free;
+    NodeChunk *chunks;
+} NodePool;
+
+NodePool nodePool = {NULL, NULL};
+
+DoubleNode *allocateNode(NodePool *pool)
+{
+    if (pool->free == NULL)
+    {
+        NodeChunk *chunk = (NodeChunk *)malloc(sizeof(NodeChunk));
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+        for (int i = 0; i < NODE_CHUNK - 1; i++)
+        {
+            chunk->nodes[i].next = &chunk->nodes[i + 1];
+        }
+        chunk->nodes[NODE_CHUNK - 1].next = NULL;
+        pool->free = chunk->nodes;
+    }
+    DoubleNode *node = pool->free;
+    pool->free = node->next;
+    return node;
+}
+
+void releaseNode(NodePool *pool, DoubleNode *node)
+{
+    node->next = pool->free;
+    pool->free = node;
+}
+
+void destroyNodePool(NodePool *pool)
+{
+    while (pool->chunks != NULL)
+    {
+        NodeChunk *next = pool->chunks->next;
+        free(pool->chunks);
+        pool->chunks = next;
+    }
+    pool->free = NULL;
+}
+
+/*Doubly Linked List
+The DoublyLinkedList structure has the same three pointers as LinkedList. The head's
+previous pointer and the tail's next pointer are NULL:*/
+
+typedef struct _doublyLinkedList
+{
+    DoubleNode *head;
+    DoubleNode *tail;
+    DoubleNode *current;
+} DoublyLinkedList;
+
+void initializeDoublyList(DoublyLinkedList *list)
+{
+    list->head = NULL;
+    list->tail = NULL;
+    list->current = NULL;
+}
+
+/*The add functions return the new node, or NULL if no node could be allocated. The caller
+can keep the node as a handle and later unlink it directly, without searching for it:*/
+
+DoubleNode *addDoublyHead(DoublyLinkedList *list, void *data)
+{
+    DoubleNode *node = allocateNode(&nodePool);
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    node->data = data;
+    node->previous = NULL;
+    node->next = list->head;
+    if (list->head == NULL)
+    {
+        list->tail = node;
+    }
+    else
+    {
+        list->head->previous = node;
+    }
+    list->head = node;
+    return node;
+}
+
+DoubleNode *addDoublyTail(DoublyLinkedList *list, void *data)
+{
+    DoubleNode *node = allocateNode(&nodePool);
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    node->data = data;
+    node->next = NULL;
+    node->previous = list->tail;
+    if (list->tail == NULL)
+    {
+        list->head = node;
+    }
+    else
+    {
+        list->tail->next = node;
+    }
+    list->tail = node;
+    return node;
+}
+
+/*insertDoublySorted keeps the list ordered by a COMPARE function, inserting equal elements
+after the existing ones, like insertSorted:*/
+
+DoubleNode *insertDoublySorted(DoublyLinkedList *list, COMPARE compare, void *data)
+{
+    if (list->head == NULL || compare(data, list->head->data) < 0)
+    {
+        return addDoublyHead(list, data);
+    }
+    if (compare(data, list->tail->data) >= 0)
+    {
+        return addDoublyTail(list, data);
+    }
+    DoubleNode *following = list->head->next;
+    while (compare(data, following->data) >= 0)
+    {
+        following = following->next;
+    }
+    DoubleNode *node = allocateNode(&nodePool);
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    node->data = data;
+    node->next = following;
+    node->previous = following->previous;
+    following->previous->next = node;
+    following->previous = node;
+    return node;
+}
+
+DoubleNode *getDoublyNode(DoublyLinkedList *list, COMPARE compare, void *data)
+{
+    for (DoubleNode *node = list->head; node != NULL; node = node->next)
+    {
+        if (compare(node->data, data) == 0)
+        {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/*unlinkDoublyNode detaches a node in constant time. Only the head and tail need special
+care, because their outer links are NULL. The node keeps its data and is not freed, so it
+can be linked in again elsewhere:*/
+
+void unlinkDoublyNode(DoublyLinkedList *list, DoubleNode *node)
+{
+    if (node->previous == NULL)
+    {
+        list->head = node->next;
+    }
+    else
+    {
+        node->previous->next = node->next;
+    }
+    if (node->next == NULL)
+    {
+        list->tail = node->previous;
+    }
+    else
+    {
+        node->next->previous = node->previous;
+    }
+    if (list->current == node)
+    {
+        list->current = NULL;
+    }
+    node->next = NULL;
+    node->previous = NULL;
+}
+
+// deleteDoublyNode unlinks a node and returns it to the pool; the data still belongs to the caller:
+
+void deleteDoublyNode(DoublyLinkedList *list, DoubleNode *node)
+{
+    unlinkDoublyNode(list, node);
+    releaseNode(&nodePool, node);
+}
+
+/*moveToHead is the operation an LRU cache performs on every hit. removeDoublyTail is its
+eviction, returning the data of the least recently used entry, or NULL if the list is
+empty:*/
+
+void moveToHead(DoublyLinkedList *list, DoubleNode *node)
+{
+    if (node == list->head)
+    {
+        return;
+    }
+    unlinkDoublyNode(list, node);
+    node->next = list->head;
+    list->head->previous = node;
+    list->head = node;
+}
+
+void *removeDoublyTail(DoublyLinkedList *list)
+{
+    DoubleNode *node = list->tail;
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    void *data = node->data;
+    deleteDoublyNode(list, node);
+    return data;
+}
+
+void traverseDoubly(DoublyLinkedList *list, DISPLAY visit)
+{
+    list->current = list->head;
+    while (list->current != NULL)
+    {
+        visit(list->current->data);
+        list->current = list->current->next;
+    }
+}
+
+void traverseDoublyBackward(DoublyLinkedList *list, DISPLAY visit)
+{
+    list->current = list->tail;
+    while (list->current != NULL)
+    {
+        visit(list->current->data);
+        list->current = list->current->previous;
+    }
+}
+
+/*As in destroyList, the nodes are already chained through their next fields, so the whole
+list is spliced onto the free list in constant time:*/
+
+void destroyDoublyList(DoublyLinkedList *list)
+{
+    if (list->head != NULL)
+    {
+        list->tail->next = nodePool.free;
+        nodePool.free = list->head;
+    }
+    initializeDoublyList(list);
+}
+
+/*Circular List
+The circular list embeds its sentinel, so an empty list is a sentinel linked to itself.
+The first node is sentinel.next and the last is sentinel.previous:*/
+
+typedef struct _circularList
+{
+    DoubleNode sentinel;
+    size_t count;
+} CircularList;
+
+void initializeCircularList(CircularList *list)
+{
+    list->sentinel.data = NULL;
+    list->sentinel.next = &list->sentinel;
+    list->sentinel.previous = &list->sentinel;
+    list->count = 0;
+}
+
+/*Every insertion is the same four assignments, placing a node between two neighbours that
+are known to exist. Adding at the head inserts after the sentinel, and adding at the tail
+inserts before it:*/
+
+DoubleNode *insertCircularAfter(CircularList *list, DoubleNode *position, void *data)
+{
+    DoubleNode *node = allocateNode(&nodePool);
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    node->data = data;
+    node->previous = position;
+    node->next = position->next;
+    position->next->previous = node;
+    position->next = node;
+    list->count++;
+    return node;
+}
+
+DoubleNode *addCircularHead(CircularList *list, void *data)
+{
+    return insertCircularAfter(list, &list->sentinel, data);
+}
+
+DoubleNode *addCircularTail(CircularList *list, void *data)
+{
+    return insertCircularAfter(list, list->sentinel.previous, data);
+}
+
+// Removal is likewise two assignments, with no special cases at all:
+
+void *removeCircular(CircularList *list, DoubleNode *node)
+{
+    void *data = node->data;
+    node->previous->next = node->next;
+    node->next->previous = node->previous;
+    releaseNode(&nodePool, node);
+    list->count--;
+    return data;
+}
+
+/*removeCircularHead makes the circular list a queue when nodes are added at the tail. It
+returns NULL when the list is empty:*/
+
+void *removeCircularHead(CircularList *list)
+{
+    if (list->count == 0)
+    {
+        return NULL;
+    }
+    return removeCircular(list, list->sentinel.next);
+}
+
+/*rotateCircular moves the first node to the end, which is how a round-robin scheduler
+hands the next turn to the next entry. Only the sentinel moves; no data is copied:*/
+
+void rotateCircular(CircularList *list)
+{
+    if (list->count < 2)
+    {
+        return;
+    }
+    DoubleNode *sentinel = &list->sentinel;
+    DoubleNode *first = sentinel->next;
+    sentinel->previous->next = first;
+    first->previous = sentinel->previous;
+    sentinel->next = first->next;
+    first->next->previous = sentinel;
+    first->next = sentinel;
+    sentinel->previous = first;
+}
+
+DoubleNode *getCircularNode(CircularList *list, COMPARE compare, void *data)
+{
+    for (DoubleNode *node = list->sentinel.next; node != &list->sentinel; node = node->next)
+    {
+        if (compare(node->data, data) == 0)
+        {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+void traverseCircular(CircularList *list, DISPLAY visit)
+{
+    for (DoubleNode *node = list->sentinel.next; node != &list->sentinel; node = node->next)
+    {
+        visit(node->data);
+    }
+}
+
+void destroyCircularList(CircularList *list)
+{
+    while (list->count > 0)
+    {
+        removeCircular(list, list->sentinel.next);
+    }
+}
+
+/*The program below uses both lists with the employees from Linkedlist.c, and then times
+removal through node handles. Every node of a list is removed in random order, and the
+time per removal stays the same whatever the length of the list:*/
+
+double elapsedMilliseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int main()
+{
+    Employee *samuel = (Employee *)malloc(sizeof(Employee));
+    strcpy(samuel->name, "Samuel");
+    samuel->age = 32;
+    Employee *sally = (Employee *)malloc(sizeof(Employee));
+    strcpy(sally->name, "Sally");
+    sally->age = 28;
+    Employee *susan = (Employee *)malloc(sizeof(Employee));
+    strcpy(susan->name, "Susan");
+    susan->age = 45;
+
+    DoublyLinkedList list;
+    initializeDoublyList(&list);
+    DoubleNode *susanNode = insertDoublySorted(&list, (COMPARE)compareEmployee, susan);
+    insertDoublySorted(&list, (COMPARE)compareEmployee, samuel);
+    insertDoublySorted(&list, (COMPARE)compareEmployee, sally);
+    printf("\nDoubly Linked List\n");
+    traverseDoubly(&list, (DISPLAY)displayEmployee);
+    printf("\nBackward\n");
+    traverseDoublyBackward(&list, (DISPLAY)displayEmployee);
+
+    // Using the list as an LRU order: Susan is used, so Samuel becomes the one evicted
+    moveToHead(&list, susanNode);
+    Employee *evicted = (Employee *)removeDoublyTail(&list);
+    printf("\nAfter using Susan, evicted %s\n", evicted->name);
+    traverseDoubly(&list, (DISPLAY)displayEmployee);
+    destroyDoublyList(&list);
+
+    CircularList ring;
+    initializeCircularList(&ring);
+    addCircularTail(&ring, samuel);
+    addCircularTail(&ring, sally);
+    addCircularTail(&ring, susan);
+    rotateCircular(&ring);
+    printf("\nCircular List, rotated once\n");
+    traverseCircular(&ring, (DISPLAY)displayEmployee);
+    removeCircular(&ring, getCircularNode(&ring, (COMPARE)compareEmployee, sally));
+    printf("\nAfter removing Sally\n");
+    traverseCircular(&ring, (DISPLAY)displayEmployee);
+    destroyCircularList(&ring);
+
+    printf("\nnodes\t\tdoubly ns/unlink\tcircular ns/unlink\n");
+    for (long count = 10000; count <= 1000000; count *= 10)
+    {
+        DoubleNode **handles = (DoubleNode **)malloc(count * sizeof(DoubleNode *));
+        long *order = (long *)malloc(count * sizeof(long));
+        unsigned long state = 9;
+        for (long i = 0; i < count; i++)
+        {
+            order[i] = i;
+        }
+        for (long i = count - 1; i > 0; i--)
+        {
+            state = state * 6364136223846793005UL + 1442695040888963407UL;
+            long j = (long)((state >> 33) % (unsigned long)(i + 1));
+            long swap = order[i];
+            order[i] = order[j];
+            order[j] = swap;
+        }
+        struct timespec start, end;
+
+        for (long i = 0; i < count; i++)
+        {
+            handles[i] = addDoublyTail(&list, samuel);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long i = 0; i < count; i++)
+        {
+            deleteDoublyNode(&list, handles[order[i]]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double doubly = elapsedMilliseconds(&start, &end) * 1e6 / count;
+
+        for (long i = 0; i < count; i++)
+        {
+            handles[i] = addCircularTail(&ring, samuel);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long i = 0; i < count; i++)
+        {
+            removeCircular(&ring, handles[order[i]]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double circular = elapsedMilliseconds(&start, &end) * 1e6 / count;
+
+        printf("%ld%s\t%.1f\t\t\t%.1f%s\n", count, count < 1000000 ? "\t" : "", doubly, circular,
+               list.head == NULL && ring.count == 0 ? "" : "\tNOT EMPTY");
+        free(order);
+        free(handles);
+    }
+
+    destroyNodePool(&nodePool);
+    free(samuel);
+    free(sally);
+    free(susan);
+    return 0;
+}
+
+/*Removal costs a few nanoseconds for short lists and somewhat more for long ones, where
+the nodes visited in random order no longer fit in the cache. That growth comes from
+memory, not from the algorithm: no removal looks at any node other than the one removed
+and its two neighbours.*/
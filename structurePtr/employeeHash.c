@@ -0,0 +1,495 @@
+// Hash Index for Employees
+
+/*Looking up an employee by name in a linked list means comparing the name against every
+employee until a match turns up. A hash table instead computes a number from the name
+and uses it to go almost directly to the right place.
+
+This table uses open addressing. All entries live in one flat array, and the employees
+are stored inline in it, so a lookup reads the array and nothing else. The name's hash
+picks a home slot. If the home slot is taken by another employee, the entry goes in the
+next free slot after it, which is called linear probing. The distance from an entry's
+home slot to where it actually sits is its probe distance.
+
+Robin Hood hashing keeps those distances short. While an insertion probes, it compares
+its own distance with that of each entry it passes. If it has come further than the
+entry in the slot, it takes that slot and carries on inserting the displaced entry
+instead. This takes from the rich, entries near home, and gives to the poor, so no entry
+ends up far from its home slot, and a search can stop as soon as it reaches an entry that
+is closer to home than the search is.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+int compareEmployee(Employee *e1, Employee *e2)
+{
+    return strcmp(e1->name, e2->name);
+}
+
+/*Each slot stores the employee next to its 32-bit hash. A hash of zero marks an empty
+slot, so hashName never returns zero. Comparing hashes first means the names are only
+compared when they are almost certainly equal:*/
+
+typedef struct _hashSlot
+{
+    uint32_t hash;
+    Employee employee;
+} HashSlot;
+
+typedef struct _hashTable
+{
+    HashSlot *slots;
+    size_t mask;
+    size_t count;
+} HashTable;
+
+uint32_t hashName(const char *name)
+{
+    uint64_t hash = 14695981039346656037UL;
+    for (int i = 0; i < 32 && name[i] != '\0'; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 1099511628211UL;
+    }
+    uint32_t folded = (uint32_t)(hash ^ (hash >> 32));
+    return folded != 0 ? folded : 1;
+}
+
+size_t probeDistance(HashTable *table, size_t position, uint32_t hash)
+{
+    return (position - (hash & table->mask)) & table->mask;
+}
+
+int initializeTable(HashTable *table, size_t capacity)
+{
+    table->slots = (HashSlot *)calloc(capacity, sizeof(HashSlot));
+    table->mask = capacity - 1;
+    table->count = 0;
+    return table->slots != NULL;
+}
+
+/*tableFind probes from the home slot until it finds the name, reaches an empty slot, or
+reaches an entry whose probe distance is smaller than the distance searched so far. In
+the last two cases the name cannot be further along:*/
+
+HashSlot *tableFind(HashTable *table, const char *name, uint32_t hash)
+{
+    size_t position = hash & table->mask;
+    for (size_t distance = 0;; distance++)
+    {
+        HashSlot *slot = &table->slots[position];
+        if (slot->hash == 0 || probeDistance(table, position, slot->hash) < distance)
+        {
+            return NULL;
+        }
+        if (slot->hash == hash && strncmp(slot->employee.name, name, 32) == 0)
+        {
+            return slot;
+        }
+        position = (position + 1) & table->mask;
+    }
+}
+
+// tableInsert places an entry that is known not to be in the table, swapping as it goes:
+
+void tableInsert(HashTable *table, HashSlot entry)
+{
+    size_t position = entry.hash & table->mask;
+    size_t distance = 0;
+    for (;;)
+    {
+        HashSlot *slot = &table->slots[position];
+        if (slot->hash == 0)
+        {
+            *slot = entry;
+            table->count++;
+            return;
+        }
+        size_t existing = probeDistance(table, position, slot->hash);
+        if (existing < distance)
+        {
+            HashSlot displaced = *slot;
+            *slot = entry;
+            entry = displaced;
+            distance = existing;
+        }
+        position = (position + 1) & table->mask;
+        distance++;
+    }
+}
+
+/*Deleting cannot simply empty the slot, because that would end the search for entries
+further along the same run. Instead, the entries after it are shifted back one slot
+until an empty slot or an entry already in its home slot is reached. This is called
+backward-shift deletion, and it leaves the table exactly as if the deleted entry had
+never been inserted:*/
+
+void tableRemove(HashTable *table, HashSlot *slot)
+{
+    size_t position = slot - table->slots;
+    for (;;)
+    {
+        size_t next = (position + 1) & table->mask;
+        HashSlot *following = &table->slots[next];
+        if (following->hash == 0 || probeDistance(table, next, following->hash) == 0)
+        {
+            break;
+        }
+        table->slots[position] = *following;
+        position = next;
+    }
+    table->slots[position].hash = 0;
+    table->count--;
+}
+
+/*Growing a table normally means allocating a larger array and reinserting every entry at
+once. For a table of millions of employees that is a pause of many milliseconds on one
+unlucky insertion. The EmployeeIndex grows incrementally instead. When the table gets
+too full, a table twice the size becomes current and the old table is kept. Every
+subsequent operation then moves a few runs of entries from the old table to the new
+one, and lookups check both tables until the old one is empty and freed.
+
+Runs are moved whole. A run starts at an entry in its home slot and ends before the
+next empty slot or home-slot entry. Removing a whole run never disturbs the search for
+an entry outside it, so the old table stays searchable throughout.
+
+Freeing the old table at the end would undo most of this. By then it may be tens of
+megabytes of resident pages, and handing them all back to the operating system at once
+takes milliseconds. So the old table is released in pieces as it empties. Once
+RELEASE_SLOTS more slots have been migrated, the whole pages they cover are returned
+with madvise(MADV_DONTNEED). A migrated slot is already empty, and the pages read back as
+zeros, so to a lookup those slots still look empty. The final free then has almost
+nothing left to release:*/
+
+#define MAX_LOAD_NUMERATOR 7
+#define MAX_LOAD_DENOMINATOR 8
+#define MIGRATE_SLOTS 64
+#define RELEASE_SLOTS 4096
+
+typedef struct _employeeIndex
+{
+    HashTable current;
+    HashTable old;
+    size_t migrateStart;
+    size_t migrated;
+    size_t released;
+} EmployeeIndex;
+
+int initializeIndex(EmployeeIndex *index, size_t capacity)
+{
+    size_t size = 16;
+    while (size < capacity)
+    {
+        size *= 2;
+    }
+    index->old.slots = NULL;
+    return initializeTable(&index->current, size);
+}
+
+void destroyIndex(EmployeeIndex *index)
+{
+    free(index->current.slots);
+    free(index->old.slots);
+    index->current.slots = NULL;
+    index->old.slots = NULL;
+}
+
+// releaseSlots returns the pages lying wholly inside slots first to last - 1 of a table
+
+void releaseSlots(HashTable *table, size_t first, size_t last)
+{
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)(table->slots + first) + page - 1) & ~(page - 1);
+    uintptr_t end = (uintptr_t)(table->slots + last) & ~(page - 1);
+    if (start < end)
+    {
+        madvise((void *)start, end - start, MADV_DONTNEED);
+    }
+}
+
+/*Migration runs from migrateStart to the end of the old table and then wraps to its start,
+so the slots migrated since the last release may form two pieces of the array:*/
+
+void releaseMigrated(EmployeeIndex *index)
+{
+    size_t capacity = index->old.mask + 1;
+    size_t first = index->migrateStart + index->released;
+    size_t last = index->migrateStart + index->migrated;
+    if (first < capacity && last > capacity)
+    {
+        releaseSlots(&index->old, first, capacity);
+        first = capacity;
+    }
+    if (first >= capacity)
+    {
+        releaseSlots(&index->old, first - capacity, last - capacity);
+    }
+    else
+    {
+        releaseSlots(&index->old, first, last);
+    }
+    index->released = index->migrated;
+}
+
+void migrateStep(EmployeeIndex *index)
+{
+    HashTable *old = &index->old;
+    size_t capacity = old->mask + 1;
+    size_t processed = 0;
+    while (processed < MIGRATE_SLOTS && index->migrated < capacity)
+    {
+        size_t position = (index->migrateStart + index->migrated) & old->mask;
+        HashSlot *slot = &old->slots[position];
+        if (slot->hash != 0)
+        {
+            tableInsert(&index->current, *slot);
+            slot->hash = 0;
+            old->count--;
+        }
+        index->migrated++;
+        processed++;
+    }
+    // Stop only at a run boundary, so that a partly moved run is never left behind
+    while (index->migrated < capacity)
+    {
+        size_t position = (index->migrateStart + index->migrated) & old->mask;
+        HashSlot *slot = &old->slots[position];
+        if (slot->hash == 0 || probeDistance(old, position, slot->hash) == 0)
+        {
+            break;
+        }
+        tableInsert(&index->current, *slot);
+        slot->hash = 0;
+        old->count--;
+        index->migrated++;
+    }
+    if (index->migrated == capacity || old->count == 0)
+    {
+        free(old->slots);
+        old->slots = NULL;
+    }
+    else if (index->migrated - index->released >= RELEASE_SLOTS)
+    {
+        releaseMigrated(index);
+    }
+}
+
+/*Migration starts at the first empty slot of the old table, so that no run wraps around
+the migration's starting point. With the load kept below seven eighths there is always
+an empty slot:*/
+
+void startResize(EmployeeIndex *index)
+{
+    HashTable bigger;
+    if (!initializeTable(&bigger, (index->current.mask + 1) * 2))
+    {
+        return;
+    }
+    index->old = index->current;
+    index->current = bigger;
+    index->migrated = 0;
+    index->released = 0;
+    index->migrateStart = 0;
+    while (index->old.slots[index->migrateStart].hash != 0)
+    {
+        index->migrateStart++;
+    }
+}
+
+Employee *findEmployee(EmployeeIndex *index, const char *name)
+{
+    uint32_t hash = hashName(name);
+    HashSlot *slot = tableFind(&index->current, name, hash);
+    if (slot == NULL && index->old.slots != NULL)
+    {
+        slot = tableFind(&index->old, name, hash);
+    }
+    return slot != NULL ? &slot->employee : NULL;
+}
+
+/*insertEmployee copies the employee into the index, replacing any employee with the same
+name. New entries always go into the current table:*/
+
+void insertEmployee(EmployeeIndex *index, Employee *employee)
+{
+    if (index->old.slots != NULL)
+    {
+        migrateStep(index);
+    }
+    uint32_t hash = hashName(employee->name);
+    HashSlot *slot = tableFind(&index->current, employee->name, hash);
+    if (slot != NULL)
+    {
+        slot->employee = *employee;
+        return;
+    }
+    if (index->old.slots != NULL && (slot = tableFind(&index->old, employee->name, hash)) != NULL)
+    {
+        tableRemove(&index->old, slot);
+    }
+    HashTable *current = &index->current;
+    if (index->old.slots == NULL &&
+        (current->count + 1) * MAX_LOAD_DENOMINATOR > (current->mask + 1) * MAX_LOAD_NUMERATOR)
+    {
+        startResize(index);
+    }
+    HashSlot entry;
+    entry.hash = hash;
+    entry.employee = *employee;
+    tableInsert(&index->current, entry);
+}
+
+int deleteEmployee(EmployeeIndex *index, const char *name)
+{
+    if (index->old.slots != NULL)
+    {
+        migrateStep(index);
+    }
+    uint32_t hash = hashName(name);
+    HashSlot *slot = tableFind(&index->current, name, hash);
+    if (slot != NULL)
+    {
+        tableRemove(&index->current, slot);
+        return 1;
+    }
+    if (index->old.slots != NULL && (slot = tableFind(&index->old, name, hash)) != NULL)
+    {
+        tableRemove(&index->old, slot);
+        return 1;
+    }
+    return 0;
+}
+
+size_t indexCount(EmployeeIndex *index)
+{
+    return index->current.count + (index->old.slots != NULL ? index->old.count : 0);
+}
+
+/*The benchmark grows the index from 16 slots to hold a million employees, recording the
+slowest single insertion and the slowest of those that finished a migration, then compares exact-match lookups with a search of a linked
+list through compareEmployee:*/
+
+#define EMPLOYEES 1000000
+#define LIST_SEARCHES 50
+
+typedef struct _node
+{
+    void *data;
+    struct _node *next;
+} Node;
+
+double elapsedNanoseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main()
+{
+    EmployeeIndex index;
+    initializeIndex(&index, 16);
+    Employee *employees = (Employee *)calloc(EMPLOYEES, sizeof(Employee));
+    for (int i = 0; i < EMPLOYEES; i++)
+    {
+        snprintf(employees[i].name, sizeof(employees[i].name), "employee%07d", i);
+        employees[i].age = (unsigned char)(i % 100);
+    }
+
+    struct timespec start, end, before, after;
+    double slowest = 0;
+    double slowestFinish = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < EMPLOYEES; i++)
+    {
+        int migrating = index.old.slots != NULL;
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        insertEmployee(&index, &employees[i]);
+        clock_gettime(CLOCK_MONOTONIC, &after);
+        double ns = elapsedNanoseconds(&before, &after);
+        if (ns > slowest)
+        {
+            slowest = ns;
+        }
+        if (migrating && index.old.slots == NULL && ns > slowestFinish)
+        {
+            slowestFinish = ns;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("insert: %.0f ns/op including timing, slowest %.0f ns, %zu slots\n",
+           elapsedNanoseconds(&start, &end) / EMPLOYEES, slowest, index.current.mask + 1);
+    printf("slowest insert that finished a migration: %.0f ns\n", slowestFinish);
+
+    unsigned long state = 7;
+    int found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < EMPLOYEES; i++)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        found += findEmployee(&index, employees[(state >> 33) % EMPLOYEES].name) != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("hash find: %.0f ns/op (%d found)\n", elapsedNanoseconds(&start, &end) / EMPLOYEES, found);
+
+    Node *head = NULL;
+    for (int i = EMPLOYEES - 1; i >= 0; i--)
+    {
+        Node *node = (Node *)malloc(sizeof(Node));
+        node->data = &employees[i];
+        node->next = head;
+        head = node;
+    }
+    found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int s = 0; s < LIST_SEARCHES; s++)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        Employee *key = &employees[(state >> 33) % EMPLOYEES];
+        for (Node *node = head; node != NULL; node = node->next)
+        {
+            if (compareEmployee((Employee *)node->data, key) == 0)
+            {
+                found++;
+                break;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("list find: %.0f ns/op (%d found)\n", elapsedNanoseconds(&start, &end) / LIST_SEARCHES, found);
+
+    for (int i = 0; i < EMPLOYEES; i += 2)
+    {
+        deleteEmployee(&index, employees[i].name);
+    }
+    printf("after deleting half: %zu employees, employee0000001 %s\n", indexCount(&index),
+           findEmployee(&index, "employee0000001") != NULL ? "found" : "missing");
+
+    while (head != NULL)
+    {
+        Node *next = head->next;
+        free(head);
+        head = next;
+    }
+    destroyIndex(&index);
+    free(employees);
+    return 0;
+}
+
+/*No insertion moves more than MIGRATE_SLOTS slots plus the rest of one run, and each
+doubling finishes migrating long before the new table fills, since the new table has
+twice the slots the old one had. The old table's pages go back in pieces of RELEASE_SLOTS
+slots, 160 KB with the default sizes, so no insertion returns more than that. Without the
+pieces, the insertion that finished migrating the last 40 MB table spent 2 to 3 ms in
+free. With them, that insertion takes a few hundred microseconds, and most of that is
+unmapping the now empty array. The slowest insertion overall can still be slower on a
+busy machine, where it is usually an insertion that was preempted rather than one that
+did more work.*/
@@ -0,0 +1,486 @@
+// Streaming Employees in Chunks
+
+/*A dataset larger than memory cannot be loaded, changed, and saved as a whole. It has to
+be streamed: written and read a piece at a time through a buffer of fixed size, so the
+memory used is the same for a thousand employees or a billion.
+
+The format below groups employees into chunks. Each chunk starts with a small header
+giving the number of records it holds, its position in the stream, and a checksum of its
+records. The records themselves are packed one after another exactly as they sit in
+memory, so writing is a memcpy into the buffer and reading hands out pointers straight
+into it. There is no allocation per record and no formatting with printf.
+
+Checksumming per chunk rather than per file means damage is found as soon as the chunk
+containing it is read, and it is clear which records are affected. The sequence number
+catches chunks that were lost or reordered, which a checksum over each chunk alone would
+not notice.*/
+
+// Compile with: gcc -O2 employeeStream.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <nmmintrin.h>
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+/*The file header is written once. It records the record size and the number of records
+per chunk, so a reader built with a different Employee layout refuses the file instead of
+misreading it. Every chunk except the last is full:*/
+
+#define STREAM_MAGIC "EMPSTRM"
+#define STREAM_VERSION 1
+#define CHUNK_MAGIC 0x4b4e4843u
+#define CHUNK_RECORDS 4096
+
+typedef struct _streamHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t chunkRecords;
+    uint32_t reserved;
+} StreamHeader;
+
+typedef struct _chunkHeader
+{
+    uint32_t magic;
+    uint32_t count;
+    uint64_t sequence;
+    uint32_t checksum;
+    uint32_t reserved;
+} ChunkHeader;
+
+/*The checksum is CRC-32C. Processors with SSE4.2 compute it eight bytes per instruction,
+fast enough that checksumming does not slow down the stream. Other processors use the
+usual table-driven version, one byte at a time. The function is chosen once, in the same
+way as the kernels in employeeTable.c:*/
+
+uint32_t crcTable[256];
+
+uint32_t crc32cTable(uint32_t crc, const void *data, size_t length)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = crcTable[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+__attribute__((target("sse4.2"))) uint32_t crc32cSSE42(uint32_t crc, const void *data, size_t length)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint64_t value = ~crc & 0xffffffffu;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        value = _mm_crc32_u64(value, word);
+    }
+    uint32_t tail = (uint32_t)value;
+    for (; i < length; i++)
+    {
+        tail = _mm_crc32_u8(tail, bytes[i]);
+    }
+    return ~tail;
+}
+
+uint32_t (*crc32c)(uint32_t, const void *, size_t) = crc32cTable;
+
+const char *chooseChecksum()
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0x82f63b78u & (0u - (crc & 1)));
+        }
+        crcTable[i] = crc;
+    }
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        crc32c = crc32cSSE42;
+        return "SSE4.2";
+    }
+    return "table";
+}
+
+/*read and write may transfer fewer bytes than asked for, and may be interrupted by a
+signal. These two helpers retry until the whole block has moved. readFully returns the
+number of bytes read, which is less than asked for only at the end of the file:*/
+
+int writeFully(int fd, const void *data, size_t length)
+{
+    const char *bytes = (const char *)data;
+    while (length > 0)
+    {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        bytes += written;
+        length -= written;
+    }
+    return 0;
+}
+
+ssize_t readFully(int fd, void *data, size_t length)
+{
+    char *bytes = (char *)data;
+    size_t total = 0;
+    while (total < length)
+    {
+        ssize_t got = read(fd, bytes + total, length - total);
+        if (got < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (got == 0)
+        {
+            break;
+        }
+        total += got;
+    }
+    return total;
+}
+
+/*Both the writer and the reader keep one chunk in a buffer allocated when they are
+opened. The chunk header sits directly in front of the records, so a whole chunk goes to
+or comes from the file in a single system call, and the file descriptor is used directly
+so that the data is not copied again into a stdio buffer:*/
+
+typedef struct _chunk
+{
+    ChunkHeader header;
+    Employee records[CHUNK_RECORDS];
+} Chunk;
+
+typedef struct _employeeWriter
+{
+    int fd;
+    Chunk *chunk;
+    uint64_t sequence;
+    int failed;
+} EmployeeWriter;
+
+int openEmployeeWriter(EmployeeWriter *writer, const char *path)
+{
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    writer->chunk = (Chunk *)malloc(sizeof(Chunk));
+    writer->sequence = 0;
+    writer->failed = 0;
+    StreamHeader header = {STREAM_MAGIC, STREAM_VERSION, sizeof(Employee), CHUNK_RECORDS, 0};
+    if (writer->fd < 0 || writer->chunk == NULL || writeFully(writer->fd, &header, sizeof(header)) != 0)
+    {
+        if (writer->fd >= 0)
+        {
+            close(writer->fd);
+        }
+        free(writer->chunk);
+        return -1;
+    }
+    writer->chunk->header.count = 0;
+    return 0;
+}
+
+/*flushChunk fills in the header and writes the chunk out. A partly filled last chunk is
+written with only the records it holds:*/
+
+void flushChunk(EmployeeWriter *writer)
+{
+    Chunk *chunk = writer->chunk;
+    if (chunk->header.count == 0 || writer->failed)
+    {
+        return;
+    }
+    size_t bytes = chunk->header.count * sizeof(Employee);
+    chunk->header.magic = CHUNK_MAGIC;
+    chunk->header.sequence = writer->sequence++;
+    chunk->header.checksum = crc32c(0, chunk->records, bytes);
+    chunk->header.reserved = 0;
+    if (writeFully(writer->fd, chunk, sizeof(ChunkHeader) + bytes) != 0)
+    {
+        writer->failed = 1;
+    }
+    chunk->header.count = 0;
+}
+
+void writeEmployee(EmployeeWriter *writer, const Employee *employee)
+{
+    Chunk *chunk = writer->chunk;
+    memcpy(&chunk->records[chunk->header.count++], employee, sizeof(Employee));
+    if (chunk->header.count == CHUNK_RECORDS)
+    {
+        flushChunk(writer);
+    }
+}
+
+// closeEmployeeWriter returns -1 if any write failed, so a truncated file is not mistaken for a good one:
+
+int closeEmployeeWriter(EmployeeWriter *writer)
+{
+    flushChunk(writer);
+    int failed = writer->failed;
+    if (close(writer->fd) != 0)
+    {
+        failed = 1;
+    }
+    free(writer->chunk);
+    writer->chunk = NULL;
+    return failed ? -1 : 0;
+}
+
+/*The reader loads one chunk at a time and hands out its records one by one. The pointer
+readEmployee returns stays valid only until the next chunk is loaded, so a caller that
+wants to keep a record must copy it. readEmployee returns NULL at the end of the stream
+and also when a chunk is damaged, in which case error says why:*/
+
+#define STREAM_OK 0
+#define STREAM_BAD_HEADER 1
+#define STREAM_BAD_CHUNK 2
+#define STREAM_BAD_CHECKSUM 3
+#define STREAM_IO_ERROR 4
+
+typedef struct _employeeReader
+{
+    int fd;
+    Chunk *chunk;
+    uint32_t position;
+    uint64_t sequence;
+    int error;
+} EmployeeReader;
+
+int openEmployeeReader(EmployeeReader *reader, const char *path)
+{
+    reader->fd = open(path, O_RDONLY);
+    reader->chunk = (Chunk *)malloc(sizeof(Chunk));
+    reader->position = 0;
+    reader->sequence = 0;
+    reader->error = STREAM_OK;
+    if (reader->fd < 0 || reader->chunk == NULL)
+    {
+        if (reader->fd >= 0)
+        {
+            close(reader->fd);
+        }
+        free(reader->chunk);
+        return -1;
+    }
+    reader->chunk->header.count = 0;
+
+    StreamHeader header;
+    if (readFully(reader->fd, &header, sizeof(header)) != sizeof(header) ||
+        memcmp(header.magic, STREAM_MAGIC, sizeof(header.magic)) != 0 || header.version != STREAM_VERSION ||
+        header.recordSize != sizeof(Employee) || header.chunkRecords != CHUNK_RECORDS)
+    {
+        reader->error = STREAM_BAD_HEADER;
+    }
+    return 0;
+}
+
+/*loadChunk reads the next chunk header and then exactly the records it announces. Each
+field is checked before it is trusted: the count must fit in the buffer, and the
+sequence number must be the one that comes next. Only then is the checksum compared:*/
+
+int loadChunk(EmployeeReader *reader)
+{
+    Chunk *chunk = reader->chunk;
+    reader->position = 0;
+    chunk->header.count = 0;
+    ChunkHeader header;
+    ssize_t got = readFully(reader->fd, &header, sizeof(header));
+    if (got == 0)
+    {
+        return 0;
+    }
+    if (got < 0)
+    {
+        reader->error = STREAM_IO_ERROR;
+        return 0;
+    }
+    if (got != sizeof(header) || header.magic != CHUNK_MAGIC || header.count == 0 ||
+        header.count > CHUNK_RECORDS || header.sequence != reader->sequence)
+    {
+        reader->error = STREAM_BAD_CHUNK;
+        return 0;
+    }
+    size_t bytes = header.count * sizeof(Employee);
+    got = readFully(reader->fd, chunk->records, bytes);
+    if (got != (ssize_t)bytes)
+    {
+        reader->error = got < 0 ? STREAM_IO_ERROR : STREAM_BAD_CHUNK;
+        return 0;
+    }
+    if (crc32c(0, chunk->records, bytes) != header.checksum)
+    {
+        reader->error = STREAM_BAD_CHECKSUM;
+        return 0;
+    }
+    chunk->header = header;
+    reader->sequence++;
+    return 1;
+}
+
+const Employee *readEmployee(EmployeeReader *reader)
+{
+    if (reader->error != STREAM_OK)
+    {
+        return NULL;
+    }
+    if (reader->position == reader->chunk->header.count && !loadChunk(reader))
+    {
+        return NULL;
+    }
+    return &reader->chunk->records[reader->position++];
+}
+
+void closeEmployeeReader(EmployeeReader *reader)
+{
+    close(reader->fd);
+    free(reader->chunk);
+    reader->chunk = NULL;
+}
+
+/*The benchmark writes N employees, reads them back while checking every record, and
+reports the throughput of each. For reference, it first writes and reads the same number
+of bytes with plain write and read calls and no formatting at all, which is as close to
+the bandwidth of the file system as a program can get. Finally it damages one byte in
+the middle of the file and reads it again to show the damage is detected. The number of
+employees defaults to four million and can be given on the command line:*/
+
+double elapsedSeconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void makeEmployee(Employee *employee, uint64_t i)
+{
+    memset(employee, 0, sizeof(Employee));
+    snprintf(employee->name, sizeof(employee->name), "employee%llu", (unsigned long long)i);
+    employee->age = (unsigned char)(18 + i % 50);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = "employees.stream";
+    long count = argc > 1 ? atol(argv[1]) : 4000000;
+    const char *checksum = chooseChecksum();
+    double megabytes = count * sizeof(Employee) / 1e6;
+    struct timespec start, end;
+
+    // Raw reference: the same number of bytes in chunk-sized writes and reads
+    Chunk *raw = (Chunk *)calloc(1, sizeof(Chunk));
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long done = 0; done < count; done += CHUNK_RECORDS)
+    {
+        long n = count - done < CHUNK_RECORDS ? count - done : CHUNK_RECORDS;
+        writeFully(fd, raw->records, n * sizeof(Employee));
+    }
+    close(fd);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double rawWrite = megabytes / elapsedSeconds(&start, &end);
+    fd = open(path, O_RDONLY);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (readFully(fd, raw->records, sizeof(raw->records)) > 0)
+    {
+    }
+    close(fd);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double rawRead = megabytes / elapsedSeconds(&start, &end);
+    free(raw);
+
+    // Prepare the records in advance, so the writer is timed and not snprintf
+    Employee *sample = (Employee *)malloc(CHUNK_RECORDS * sizeof(Employee));
+    for (int i = 0; i < CHUNK_RECORDS; i++)
+    {
+        makeEmployee(&sample[i], i);
+    }
+
+    EmployeeWriter writer;
+    if (openEmployeeWriter(&writer, path) != 0)
+    {
+        printf("could not create %s\n", path);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < count; i++)
+    {
+        writeEmployee(&writer, &sample[i % CHUNK_RECORDS]);
+    }
+    int written = closeEmployeeWriter(&writer);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double streamWrite = megabytes / elapsedSeconds(&start, &end);
+
+    EmployeeReader reader;
+    openEmployeeReader(&reader, path);
+    long read = 0, wrong = 0;
+    const Employee *employee;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ((employee = readEmployee(&reader)) != NULL)
+    {
+        wrong += memcmp(employee, &sample[read % CHUNK_RECORDS], sizeof(Employee)) != 0;
+        read++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double streamRead = megabytes / elapsedSeconds(&start, &end);
+    int error = reader.error;
+    closeEmployeeReader(&reader);
+
+    printf("checksum: %s, %ld employees, %.0f MB, %zu KB buffer\n", checksum, count, megabytes, sizeof(Chunk) / 1024);
+    printf("\t\twrite MB/s\tread MB/s\n");
+    printf("raw\t\t%.0f\t\t%.0f\n", rawWrite, rawRead);
+    printf("chunked\t\t%.0f\t\t%.0f\n", streamWrite, streamRead);
+    printf("write %s, read %ld records, %ld wrong, error %d\n", written == 0 ? "ok" : "FAILED", read, wrong, error);
+
+    // Flip one byte in the middle of the file and read it again
+    fd = open(path, O_RDWR);
+    off_t middle = lseek(fd, 0, SEEK_END) / 2;
+    unsigned char byte;
+    pread(fd, &byte, 1, middle);
+    byte ^= 0x20;
+    pwrite(fd, &byte, 1, middle);
+    close(fd);
+    openEmployeeReader(&reader, path);
+    read = 0;
+    while (readEmployee(&reader) != NULL)
+    {
+        read++;
+    }
+    printf("after damage: read %ld records before error %d\n", read, reader.error);
+    closeEmployeeReader(&reader);
+
+    free(sample);
+    unlink(path);
+    return 0;
+}
+
+/*Both streams move a chunk of about 132 KB per system call, and the only work per record
+is a 33-byte copy. What remains is the checksum. The SSE4.2 instruction checksums a few
+gigabytes per second on one core, which is more than most disks deliver, so against a
+real disk the chunked format runs close to the raw numbers. When the file is still in the
+page cache, as in this benchmark, the raw numbers are memory copies and the checksum
+becomes the limit. The memory used is one chunk buffer for the writer and one for the
+reader, whatever the size of the dataset.*/
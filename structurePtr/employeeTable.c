@@ -0,0 +1,325 @@
+// Columnar Employee Table
+
+/*An array of Employee structures stores each employee's name and age together, 33 bytes
+per employee. A query such as counting the employees between 30 and 40 only needs the
+age, but the processor loads memory in whole cache lines, so it reads all 33 bytes of
+every employee to use one of them. About 97 percent of the memory traffic is wasted.
+
+A structure of arrays turns the layout inside out. The EmployeeTable keeps one array for
+all the ages and a separate array for all the names. A scan of the age column now reads
+64 ages per cache line. The ages are also adjacent bytes, which is exactly the shape
+SIMD instructions work on: one AVX2 instruction compares 32 ages at once, and one SSE2
+instruction compares 16.
+
+Each age kernel below comes in three versions, scalar, SSE2 and AVX2. The scalar version
+is the reference and handles the few rows left over at the end of the column. The SIMD
+versions are compiled with the target attribute so that the rest of the program does
+not require AVX2, and the table picks the best version the processor supports when it is
+created.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <immintrin.h>
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+/*The age column is allocated on a 64-byte boundary, and its length is rounded up to a
+multiple of 64 with the padding set to zero, so the kernels may always load whole
+vectors. The count field is the number of real rows:*/
+
+typedef struct _employeeTable
+{
+    unsigned char *age;
+    char (*name)[32];
+    size_t count;
+    size_t capacity;
+} EmployeeTable;
+
+int initializeTable(EmployeeTable *table, size_t capacity)
+{
+    capacity = (capacity + 63) & ~(size_t)63;
+    table->age = (unsigned char *)aligned_alloc(64, capacity);
+    table->name = (char(*)[32])malloc(capacity * sizeof(*table->name));
+    table->count = 0;
+    table->capacity = capacity;
+    if (table->age == NULL || table->name == NULL)
+    {
+        return 0;
+    }
+    memset(table->age, 0, capacity);
+    return 1;
+}
+
+void destroyTable(EmployeeTable *table)
+{
+    free(table->age);
+    free(table->name);
+    table->age = NULL;
+    table->name = NULL;
+}
+
+int addEmployee(EmployeeTable *table, Employee *employee)
+{
+    if (table->count == table->capacity)
+    {
+        return 0;
+    }
+    table->age[table->count] = employee->age;
+    memcpy(table->name[table->count], employee->name, sizeof(employee->name));
+    table->count++;
+    return 1;
+}
+
+/*Scalar kernels. countAgeRange counts rows with low <= age <= high, and countAgeEqual is
+the special case low == high. selectAgeRange writes a bitmap with one bit per row, bit
+i % 32 of word i / 32, which later steps can use to pick out the matching names:*/
+
+size_t countAgeRangeScalar(const unsigned char *age, size_t count, unsigned char low, unsigned char high)
+{
+    size_t matches = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        matches += age[i] >= low && age[i] <= high;
+    }
+    return matches;
+}
+
+void selectAgeRangeScalar(const unsigned char *age, size_t start, size_t count,
+                          unsigned char low, unsigned char high, uint32_t *bitmap)
+{
+    for (size_t i = start; i < count; i++)
+    {
+        if (age[i] >= low && age[i] <= high)
+        {
+            bitmap[i / 32] |= (uint32_t)1 << (i % 32);
+        }
+    }
+}
+
+/*SIMD has no unsigned byte comparison, but it has unsigned byte minimum and maximum. An
+age lies in the range exactly when raising it to at least low and lowering it to at most
+high both leave it unchanged, so two min/max operations and two equality tests give a
+mask with 0xFF in every matching byte. movemask packs the top bit of each byte into an
+integer, one bit per row, and popcount counts them:*/
+
+__attribute__((target("sse2"))) size_t countAgeRangeSSE2(const unsigned char *age, size_t count,
+                                                        unsigned char low, unsigned char high)
+{
+    __m128i lows = _mm_set1_epi8((char)low);
+    __m128i highs = _mm_set1_epi8((char)high);
+    size_t matches = 0;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i ages = _mm_load_si128((const __m128i *)(age + i));
+        __m128i inRange = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(ages, lows), ages),
+                                        _mm_cmpeq_epi8(_mm_min_epu8(ages, highs), ages));
+        matches += __builtin_popcount(_mm_movemask_epi8(inRange));
+    }
+    return matches + countAgeRangeScalar(age + i, count - i, low, high);
+}
+
+__attribute__((target("avx2,popcnt"))) size_t countAgeRangeAVX2(const unsigned char *age, size_t count,
+                                                               unsigned char low, unsigned char high)
+{
+    __m256i lows = _mm256_set1_epi8((char)low);
+    __m256i highs = _mm256_set1_epi8((char)high);
+    size_t matches = 0;
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i ages = _mm256_load_si256((const __m256i *)(age + i));
+        __m256i inRange = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(ages, lows), ages),
+                                           _mm256_cmpeq_epi8(_mm256_min_epu8(ages, highs), ages));
+        matches += _mm_popcnt_u32((uint32_t)_mm256_movemask_epi8(inRange));
+    }
+    return matches + countAgeRangeScalar(age + i, count - i, low, high);
+}
+
+// With AVX2, each movemask result is exactly one 32-bit word of the bitmap:
+
+__attribute__((target("sse2"))) void selectAgeRangeSSE2(const unsigned char *age, size_t count,
+                                                       unsigned char low, unsigned char high, uint32_t *bitmap)
+{
+    __m128i lows = _mm_set1_epi8((char)low);
+    __m128i highs = _mm_set1_epi8((char)high);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m128i first = _mm_load_si128((const __m128i *)(age + i));
+        __m128i second = _mm_load_si128((const __m128i *)(age + i + 16));
+        __m128i firstIn = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(first, lows), first),
+                                        _mm_cmpeq_epi8(_mm_min_epu8(first, highs), first));
+        __m128i secondIn = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(second, lows), second),
+                                         _mm_cmpeq_epi8(_mm_min_epu8(second, highs), second));
+        bitmap[i / 32] = (uint32_t)_mm_movemask_epi8(firstIn) | (uint32_t)_mm_movemask_epi8(secondIn) << 16;
+    }
+    selectAgeRangeScalar(age, i, count, low, high, bitmap);
+}
+
+__attribute__((target("avx2"))) void selectAgeRangeAVX2(const unsigned char *age, size_t count,
+                                                       unsigned char low, unsigned char high, uint32_t *bitmap)
+{
+    __m256i lows = _mm256_set1_epi8((char)low);
+    __m256i highs = _mm256_set1_epi8((char)high);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i ages = _mm256_load_si256((const __m256i *)(age + i));
+        __m256i inRange = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(ages, lows), ages),
+                                           _mm256_cmpeq_epi8(_mm256_min_epu8(ages, highs), ages));
+        bitmap[i / 32] = (uint32_t)_mm256_movemask_epi8(inRange);
+    }
+    selectAgeRangeScalar(age, i, count, low, high, bitmap);
+}
+
+/*The kernels are reached through function pointers chosen once, as described in
+Functionptr/FunctionPointers.c, so each query costs one indirect call rather than a test
+of the processor's features:*/
+
+typedef size_t (*COUNT_KERNEL)(const unsigned char *, size_t, unsigned char, unsigned char);
+typedef void (*SELECT_KERNEL)(const unsigned char *, size_t, unsigned char, unsigned char, uint32_t *);
+
+void selectAgeRangeScalarAll(const unsigned char *age, size_t count, unsigned char low, unsigned char high,
+                             uint32_t *bitmap)
+{
+    selectAgeRangeScalar(age, 0, count, low, high, bitmap);
+}
+
+// Both pointers start at the scalar kernels, so the queries work before chooseKernels runs
+COUNT_KERNEL countAgeRangeKernel = countAgeRangeScalar;
+SELECT_KERNEL selectAgeRangeKernel = selectAgeRangeScalarAll;
+
+const char *chooseKernels()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    {
+        countAgeRangeKernel = countAgeRangeAVX2;
+        selectAgeRangeKernel = selectAgeRangeAVX2;
+        return "AVX2";
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        countAgeRangeKernel = countAgeRangeSSE2;
+        selectAgeRangeKernel = selectAgeRangeSSE2;
+        return "SSE2";
+    }
+    countAgeRangeKernel = countAgeRangeScalar;
+    selectAgeRangeKernel = selectAgeRangeScalarAll;
+    return "scalar";
+}
+
+// These are the queries the rest of the program uses:
+
+size_t countAgeRange(EmployeeTable *table, unsigned char low, unsigned char high)
+{
+    return countAgeRangeKernel(table->age, table->count, low, high);
+}
+
+size_t countAgeEqual(EmployeeTable *table, unsigned char age)
+{
+    return countAgeRangeKernel(table->age, table->count, age, age);
+}
+
+/*The bitmap must hold (count + 31) / 32 words and be zeroed by the caller, since the
+scalar tail only sets bits:*/
+
+void selectAgeRange(EmployeeTable *table, unsigned char low, unsigned char high, uint32_t *bitmap)
+{
+    selectAgeRangeKernel(table->age, table->count, low, high, bitmap);
+}
+
+/*The benchmark builds both layouts with the same sixteen million employees. The
+array-of-structures count reads the age field of every Employee. The other rows run the
+kernels over the age column:*/
+
+#define ROWS (16 * 1024 * 1024 + 7)
+#define REPEAT 10
+
+double elapsedMilliseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int main()
+{
+    const char *best = chooseKernels();
+    EmployeeTable table;
+    Employee *employees = (Employee *)malloc(ROWS * sizeof(Employee));
+    if (employees == NULL || !initializeTable(&table, ROWS))
+    {
+        return EXIT_FAILURE;
+    }
+    unsigned long state = 3;
+    for (size_t i = 0; i < ROWS; i++)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        snprintf(employees[i].name, sizeof(employees[i].name), "employee%08zu", i);
+        employees[i].age = (unsigned char)(18 + (state >> 33) % 50);
+        addEmployee(&table, &employees[i]);
+    }
+
+    struct timespec start, end;
+    size_t expected = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < REPEAT; r++)
+    {
+        expected = 0;
+        for (size_t i = 0; i < ROWS; i++)
+        {
+            expected += employees[i].age >= 30 && employees[i].age <= 40;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("array of structs, scalar:   %7.2f ms (%zu)\n", elapsedMilliseconds(&start, &end) / REPEAT, expected);
+
+    COUNT_KERNEL kernels[] = {countAgeRangeScalar, countAgeRangeSSE2, countAgeRangeAVX2};
+    const char *names[] = {"scalar", "SSE2", "AVX2"};
+    for (int k = 0; k < 3; k++)
+    {
+        if (k == 2 && strcmp(best, "AVX2") != 0)
+        {
+            continue;
+        }
+        size_t matches = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < REPEAT; r++)
+        {
+            matches = kernels[k](table.age, table.count, 30, 40);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("age column, %-6s count:   %7.2f ms (%zu)%s\n", names[k], elapsedMilliseconds(&start, &end) / REPEAT,
+               matches, matches == expected ? "" : " MISMATCH");
+    }
+
+    uint32_t *bitmap = (uint32_t *)calloc((ROWS + 31) / 32, sizeof(uint32_t));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    selectAgeRange(&table, 30, 40, bitmap);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    size_t selected = 0;
+    for (size_t w = 0; w < (ROWS + 31) / 32; w++)
+    {
+        selected += __builtin_popcount(bitmap[w]);
+    }
+    printf("age column, %-6s select:  %7.2f ms (%zu)%s\n", best, elapsedMilliseconds(&start, &end), selected,
+           selected == expected ? "" : " MISMATCH");
+    printf("employees aged 42: %zu\n", countAgeEqual(&table, 42));
+
+    free(bitmap);
+    free(employees);
+    destroyTable(&table);
+    return 0;
+}
+
+/*The name column keeps the same row order as the age column, so row i of the bitmap
+identifies table.name[i]. Queries touch the names only for the rows that matched, which
+is the usual pattern for columnar storage: filter on the narrow columns first, then fetch
+the wide ones.*/
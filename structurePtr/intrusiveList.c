@@ -0,0 +1,209 @@
+// Intrusive Linked List
+
+/*The Node structure in Linkedlist.c holds a pointer to the user's data. Every element
+therefore takes two allocations, one for the Employee and one for its Node, and every
+step of a traversal dereferences the node and then its data pointer.
+
+An intrusive list turns this around. Instead of a node that points to the data, the data
+contains the link. The Employee structure gets a ListLink field, and the list chains
+those fields together. Adding an employee to a list allocates nothing, since the link is
+already part of the employee, and a traversal reaches each employee directly from its
+link.
+
+The catch is that the list only knows about links. To get from a link back to the
+employee that contains it, we subtract the offset of the link field within Employee,
+which the standard offsetof macro provides. The containerOf macro below wraps that
+pointer arithmetic:*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef struct _listLink
+{
+    struct _listLink *next;
+} ListLink;
+
+#define containerOf(link, type, member) ((type *)((char *)(link) - offsetof(type, member)))
+
+/*The employee now embeds its link. An employee can be on as many lists at once as it has
+links, so here it has two, one for a directory of all employees and one for the
+employees of a single department:*/
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+    ListLink directoryLink;
+    ListLink departmentLink;
+} Employee;
+
+typedef void (*DISPLAY)(void *);
+typedef int (*COMPARE)(void *, void *);
+
+int compareEmployee(Employee *e1, Employee *e2)
+{
+    return strcmp(e1->name, e2->name);
+}
+
+void displayEmployee(Employee *employee)
+{
+    printf("%s\t%d\n", employee->name, employee->age);
+}
+
+/*The list itself holds the head and tail links, plus the offset of the link field it uses.
+Storing the offset lets the list turn links into records on its own, so the same COMPARE
+and DISPLAY functions used with Linkedlist.c work unchanged:*/
+
+typedef struct _intrusiveList
+{
+    ListLink *head;
+    ListLink *tail;
+    size_t linkOffset;
+} IntrusiveList;
+
+#define listRecord(list, link) ((void *)((char *)(link) - (list)->linkOffset))
+
+void initializeIntrusiveList(IntrusiveList *list, size_t linkOffset)
+{
+    list->head = NULL;
+    list->tail = NULL;
+    list->linkOffset = linkOffset;
+}
+
+void addIntrusiveHead(IntrusiveList *list, ListLink *link)
+{
+    link->next = list->head;
+    if (list->head == NULL)
+    {
+        list->tail = link;
+    }
+    list->head = link;
+}
+
+void addIntrusiveTail(IntrusiveList *list, ListLink *link)
+{
+    link->next = NULL;
+    if (list->head == NULL)
+    {
+        list->head = link;
+    }
+    else
+    {
+        list->tail->next = link;
+    }
+    list->tail = link;
+}
+
+/*findIntrusive returns the first record that matches the key, and removeIntrusive unlinks
+a record's link. Removing does not free anything, because the list never allocated the
+record in the first place:*/
+
+void *findIntrusive(IntrusiveList *list, COMPARE compare, void *key)
+{
+    for (ListLink *link = list->head; link != NULL; link = link->next)
+    {
+        void *record = listRecord(list, link);
+        if (compare(record, key) == 0)
+        {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+void removeIntrusive(IntrusiveList *list, ListLink *link)
+{
+    ListLink *previous = NULL;
+    ListLink *current = list->head;
+    while (current != NULL && current != link)
+    {
+        previous = current;
+        current = current->next;
+    }
+    if (current == NULL)
+    {
+        return;
+    }
+    if (previous == NULL)
+    {
+        list->head = link->next;
+    }
+    else
+    {
+        previous->next = link->next;
+    }
+    if (list->tail == link)
+    {
+        list->tail = previous;
+    }
+    link->next = NULL;
+}
+
+void traverseIntrusive(IntrusiveList *list, DISPLAY visit)
+{
+    for (ListLink *link = list->head; link != NULL; link = link->next)
+    {
+        visit(listRecord(list, link));
+    }
+}
+
+/*When the record type is known at the call site, the forEachEntry macro gives a typed loop
+without any function pointer calls at all. The compiler knows the offset, so recovering
+the record is a constant subtraction folded into the address of each field access:*/
+
+#define forEachEntry(entry, list, type, member)                              \
+    for (ListLink *_link = (list)->head;                                     \
+         _link != NULL && ((entry) = containerOf(_link, type, member), 1); \
+         _link = _link->next)
+
+int main()
+{
+    const char *names[] = {"Samuel", "Sally", "Susan", "Bob"};
+    Employee *employees = (Employee *)calloc(4, sizeof(Employee));
+    IntrusiveList directory;
+    IntrusiveList sales;
+    initializeIntrusiveList(&directory, offsetof(Employee, directoryLink));
+    initializeIntrusiveList(&sales, offsetof(Employee, departmentLink));
+
+    // One allocation holds all four employees, and adding them to lists allocates nothing
+    for (int i = 0; i < 4; i++)
+    {
+        strcpy(employees[i].name, names[i]);
+        employees[i].age = (unsigned char)(30 + i);
+        addIntrusiveTail(&directory, &employees[i].directoryLink);
+        if (i % 2 == 0)
+        {
+            addIntrusiveTail(&sales, &employees[i].departmentLink);
+        }
+    }
+
+    printf("Directory\n");
+    traverseIntrusive(&directory, (DISPLAY)displayEmployee);
+    printf("Sales\n");
+    traverseIntrusive(&sales, (DISPLAY)displayEmployee);
+
+    // Susan leaves sales but stays in the directory
+    Employee key = {.name = "Susan"};
+    Employee *susan = (Employee *)findIntrusive(&sales, (COMPARE)compareEmployee, &key);
+    removeIntrusive(&sales, &susan->departmentLink);
+
+    Employee *employee;
+    int totalAge = 0;
+    forEachEntry(employee, &directory, Employee, directoryLink)
+    {
+        totalAge += employee->age;
+    }
+    printf("Sales after Susan left\n");
+    traverseIntrusive(&sales, (DISPLAY)displayEmployee);
+    printf("Total age in directory: %d\n", totalAge);
+
+    free(employees);
+    return 0;
+}
+
+/*The price of an intrusive list is that the record's type must be designed with the list
+in mind, and a record cannot be freed while it is still linked into any list. In return
+each element needs no allocation beyond the record itself, and a traversal touches only
+the records.*/
@@ -0,0 +1,495 @@
+// Lock-Free Sorted Linked List
+
+/*Protecting the list in Linkedlist.c with one mutex is correct but serializes every
+reader and writer. A lock-free list lets all threads work on it at once, with every change
+made by a single compare-and-swap (CAS) on a next pointer.
+
+Inserting is straightforward: find the two nodes the new node goes between, point the
+new node at the second, and CAS the first node's next pointer from the second node to the
+new node. If another thread changed that pointer in the meantime, the CAS fails and the
+insert starts over.
+
+Deleting is where it gets subtle. If one thread unlinks node B from A -> B -> C while
+another inserts a node after B, the insert succeeds on a node that is no longer in the
+list and is lost. Harris's solution is to delete in two steps. First the node is marked
+by setting the lowest bit of its own next pointer. Nodes are at least pointer aligned,
+so that bit is otherwise always zero. A marked node is logically deleted, and since any
+CAS on its next pointer now fails, nothing can be inserted after it. Then the node is
+physically unlinked by a CAS on its predecessor, either by the deleting thread or by any
+other thread that comes across it while searching.*/
+
+// Compile with: gcc -O2 -pthread lockFreeList.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+typedef void (*DISPLAY)(void *);
+typedef int (*COMPARE)(void *, void *);
+
+int compareEmployee(Employee *e1, Employee *e2)
+{
+    return strcmp(e1->name, e2->name);
+}
+
+void displayEmployee(Employee *employee)
+{
+    printf("%s\t%d\n", employee->name, employee->age);
+}
+
+/*The next field holds a Node pointer and the mark bit together. The retiredNext field is
+used only after the node has been unlinked, as described below:*/
+
+typedef struct _node
+{
+    void *data;
+    _Atomic uintptr_t next;
+    struct _node *retiredNext;
+} Node;
+
+#define MARK 1u
+#define isMarked(link) ((link) & MARK)
+#define nodeOf(link) ((Node *)((link) & ~(uintptr_t)MARK))
+
+typedef struct _lockFreeList
+{
+    _Atomic uintptr_t head;
+    COMPARE compare;
+} LockFreeList;
+
+/*Safe Memory Reclamation
+Once a node is unlinked, another thread may still be standing on it in the middle of a
+traversal, so it cannot be freed right away. Epoch-based reclamation tracks when that is
+no longer possible. A global epoch counter advances over time. Every thread announces
+the epoch it saw when it started an operation and marks itself active until it finishes.
+A node unlinked in epoch e is put on its thread's limbo list for e. The global epoch only
+moves from e to e + 1 once every active thread has announced e, so when it reaches e + 2,
+no operation that started in epoch e or earlier can still be running, and the nodes
+retired in e can be freed. Three limbo lists per thread, used in rotation, are enough:*/
+
+#define MAX_THREADS 64
+#define RETIRE_THRESHOLD 64
+
+typedef struct _threadRecord
+{
+    _Alignas(64) _Atomic unsigned long epoch;
+    atomic_int active;
+    atomic_int owned;
+    unsigned long lastEpoch;
+    Node *limbo[3];
+    int retiredCount;
+} ThreadRecord;
+
+ThreadRecord records[MAX_THREADS];
+atomic_int recordCount;
+_Alignas(64) _Atomic unsigned long globalEpoch = 1;
+static _Thread_local ThreadRecord *threadRecord;
+
+void freeLimbo(ThreadRecord *record, int index)
+{
+    Node *node = record->limbo[index];
+    while (node != NULL)
+    {
+        Node *next = node->retiredNext;
+        free(node);
+        node = next;
+    }
+    record->limbo[index] = NULL;
+}
+
+/*A thread claims a free record the first time it uses a list and should release it with
+releaseThreadRecord before it exits. Its limbo lists stay with the record, and the next
+thread to claim the record frees them in due course:*/
+
+ThreadRecord *acquireThreadRecord()
+{
+    for (;;)
+    {
+        for (int i = 0; i < MAX_THREADS; i++)
+        {
+            int expected = 0;
+            if (atomic_compare_exchange_strong(&records[i].owned, &expected, 1))
+            {
+                int count = atomic_load(&recordCount);
+                while (count < i + 1 && !atomic_compare_exchange_weak(&recordCount, &count, i + 1))
+                {
+                }
+                threadRecord = &records[i];
+                return threadRecord;
+            }
+        }
+    }
+}
+
+void releaseThreadRecord()
+{
+    if (threadRecord != NULL)
+    {
+        atomic_store(&threadRecord->owned, 0);
+        threadRecord = NULL;
+    }
+}
+
+/*enterOperation announces the current epoch before the thread reads any node. If the
+epoch has moved on since the thread's last operation, the limbo list that the new epoch
+maps to only holds nodes retired at least three epochs ago, so it is freed first:*/
+
+ThreadRecord *enterOperation()
+{
+    ThreadRecord *record = threadRecord;
+    if (record == NULL)
+    {
+        record = acquireThreadRecord();
+    }
+    unsigned long epoch = atomic_load(&globalEpoch);
+    atomic_store(&record->epoch, epoch);
+    atomic_store(&record->active, 1);
+    // Read the epoch again in case it advanced before this thread was seen as active
+    epoch = atomic_load(&globalEpoch);
+    atomic_store(&record->epoch, epoch);
+    if (epoch != record->lastEpoch)
+    {
+        freeLimbo(record, epoch % 3);
+        record->lastEpoch = epoch;
+    }
+    return record;
+}
+
+void exitOperation(ThreadRecord *record)
+{
+    atomic_store_explicit(&record->active, 0, memory_order_release);
+}
+
+void tryAdvanceEpoch()
+{
+    unsigned long epoch = atomic_load(&globalEpoch);
+    int count = atomic_load(&recordCount);
+    for (int i = 0; i < count; i++)
+    {
+        if (atomic_load(&records[i].active) && atomic_load(&records[i].epoch) != epoch)
+        {
+            return;
+        }
+    }
+    atomic_compare_exchange_strong(&globalEpoch, &epoch, epoch + 1);
+}
+
+void retireNode(ThreadRecord *record, Node *node)
+{
+    int index = record->lastEpoch % 3;
+    node->retiredNext = record->limbo[index];
+    record->limbo[index] = node;
+    if (++record->retiredCount >= RETIRE_THRESHOLD)
+    {
+        record->retiredCount = 0;
+        tryAdvanceEpoch();
+    }
+}
+
+/*The search used by insert and delete returns the first node whose data does not precede
+the key, along with the link that points to it. Any marked node it passes is unlinked
+on the way, and the thread whose CAS unlinks a node is the one that retires it, so each
+node is retired exactly once. If an unlink fails, or the predecessor turns out to have
+changed, the search starts again from the head:*/
+
+Node *searchList(LockFreeList *list, void *key, _Atomic uintptr_t **previousLink, ThreadRecord *record)
+{
+retry:;
+    _Atomic uintptr_t *previous = &list->head;
+    Node *current = nodeOf(atomic_load(previous));
+    while (current != NULL)
+    {
+        uintptr_t next = atomic_load(&current->next);
+        if (isMarked(next))
+        {
+            uintptr_t expected = (uintptr_t)current;
+            if (!atomic_compare_exchange_strong(previous, &expected, (uintptr_t)nodeOf(next)))
+            {
+                goto retry;
+            }
+            retireNode(record, current);
+            current = nodeOf(next);
+            continue;
+        }
+        if (atomic_load(previous) != (uintptr_t)current)
+        {
+            goto retry;
+        }
+        if (list->compare(current->data, key) >= 0)
+        {
+            break;
+        }
+        previous = &current->next;
+        current = nodeOf(next);
+    }
+    *previousLink = previous;
+    return current;
+}
+
+void initializeLockFreeList(LockFreeList *list, COMPARE compare)
+{
+    atomic_init(&list->head, 0);
+    list->compare = compare;
+}
+
+// insertNode adds data unless an equal element is present, and returns whether it did:
+
+int insertNode(LockFreeList *list, void *data)
+{
+    ThreadRecord *record = enterOperation();
+    Node *node = (Node *)malloc(sizeof(Node));
+    node->data = data;
+    for (;;)
+    {
+        _Atomic uintptr_t *previous;
+        Node *current = searchList(list, data, &previous, record);
+        if (current != NULL && list->compare(current->data, data) == 0)
+        {
+            exitOperation(record);
+            free(node);
+            return 0;
+        }
+        atomic_store_explicit(&node->next, (uintptr_t)current, memory_order_relaxed);
+        uintptr_t expected = (uintptr_t)current;
+        if (atomic_compare_exchange_strong(previous, &expected, (uintptr_t)node))
+        {
+            exitOperation(record);
+            return 1;
+        }
+    }
+}
+
+/*deleteNode marks the node first. Whichever thread succeeds in setting the mark owns the
+deletion, so of two threads deleting the same key, only one returns 1. If the following
+unlink fails, another search is run purely to clean the node out:*/
+
+int deleteNode(LockFreeList *list, void *key)
+{
+    ThreadRecord *record = enterOperation();
+    for (;;)
+    {
+        _Atomic uintptr_t *previous;
+        Node *current = searchList(list, key, &previous, record);
+        if (current == NULL || list->compare(current->data, key) != 0)
+        {
+            exitOperation(record);
+            return 0;
+        }
+        uintptr_t next = atomic_load(&current->next);
+        if (isMarked(next))
+        {
+            continue;
+        }
+        if (!atomic_compare_exchange_strong(&current->next, &next, next | MARK))
+        {
+            continue;
+        }
+        uintptr_t expected = (uintptr_t)current;
+        if (atomic_compare_exchange_strong(previous, &expected, next))
+        {
+            retireNode(record, current);
+        }
+        else
+        {
+            searchList(list, key, &previous, record);
+        }
+        exitOperation(record);
+        return 1;
+    }
+}
+
+/*containsNode never writes. It walks past marked nodes without unlinking them and reports
+a match only if the matching node is not marked:*/
+
+int containsNode(LockFreeList *list, void *key)
+{
+    ThreadRecord *record = enterOperation();
+    Node *current = nodeOf(atomic_load(&list->head));
+    while (current != NULL && list->compare(current->data, key) < 0)
+    {
+        current = nodeOf(atomic_load(&current->next));
+    }
+    int found = current != NULL && list->compare(current->data, key) == 0 &&
+                !isMarked(atomic_load(&current->next));
+    exitOperation(record);
+    return found;
+}
+
+void traverseLockFree(LockFreeList *list, DISPLAY visit)
+{
+    ThreadRecord *record = enterOperation();
+    for (Node *node = nodeOf(atomic_load(&list->head)); node != NULL; node = nodeOf(atomic_load(&node->next)))
+    {
+        if (!isMarked(atomic_load(&node->next)))
+        {
+            visit(node->data);
+        }
+    }
+    exitOperation(record);
+}
+
+/*When no thread is using the list any more, destroyLockFreeList frees the remaining nodes
+and every limbo list:*/
+
+void destroyLockFreeList(LockFreeList *list)
+{
+    Node *node = nodeOf(atomic_load(&list->head));
+    while (node != NULL)
+    {
+        Node *next = nodeOf(atomic_load(&node->next));
+        free(node);
+        node = next;
+    }
+    atomic_store(&list->head, 0);
+    for (int i = 0; i < MAX_THREADS; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            freeLimbo(&records[i], j);
+        }
+    }
+}
+
+/*The stress test runs threads that insert, delete and look up random employees from a
+fixed set of KEYS. A linearizable list behaves as if each operation happened at one
+instant, so for every key the successful inserts and deletes must alternate, starting
+with an insert. Each thread counts its successful operations per key. At the end, for
+every key, inserts minus deletes must be 0 or 1 and must equal whether the key is in the
+final list, and the list must be strictly sorted. Building with -fsanitize=address also
+catches any node freed while a thread could still reach it.
+
+The same run measures throughput for a read-heavy mix, 90 percent lookups, and a
+write-heavy mix, 50 percent inserts and 50 percent deletes:*/
+
+#define KEYS 256
+#define OPERATIONS 200000
+#define STRESS_THREADS 16
+
+Employee keys[KEYS];
+LockFreeList employees;
+
+typedef struct _stressArgs
+{
+    int lookupPercent;
+    long operations;
+    unsigned long seed;
+    long inserted[KEYS];
+    long deleted[KEYS];
+} StressArgs;
+
+void *stressThread(void *arg)
+{
+    StressArgs *args = (StressArgs *)arg;
+    unsigned long state = args->seed;
+    for (long n = 0; n < args->operations; n++)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        int key = (int)((state >> 33) % KEYS);
+        int choice = (int)((state >> 16) % 100);
+        if (choice < args->lookupPercent)
+        {
+            containsNode(&employees, &keys[key]);
+        }
+        else if ((choice - args->lookupPercent) % 2 == 0)
+        {
+            args->inserted[key] += insertNode(&employees, &keys[key]);
+        }
+        else
+        {
+            args->deleted[key] += deleteNode(&employees, &keys[key]);
+        }
+    }
+    releaseThreadRecord();
+    return NULL;
+}
+
+long runStress(int threads, int lookupPercent, double *seconds)
+{
+    pthread_t ids[STRESS_THREADS];
+    StressArgs *args = (StressArgs *)calloc(threads, sizeof(StressArgs));
+    struct timespec start, end;
+    initializeLockFreeList(&employees, (COMPARE)compareEmployee);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < threads; t++)
+    {
+        args[t].lookupPercent = lookupPercent;
+        args[t].operations = OPERATIONS / threads;
+        args[t].seed = 977 * (t + 1);
+        pthread_create(&ids[t], NULL, stressThread, &args[t]);
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_join(ids[t], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    long errors = 0;
+    for (int k = 0; k < KEYS; k++)
+    {
+        long balance = 0;
+        for (int t = 0; t < threads; t++)
+        {
+            balance += args[t].inserted[k] - args[t].deleted[k];
+        }
+        if (balance != containsNode(&employees, &keys[k]))
+        {
+            errors++;
+        }
+    }
+    Node *node = nodeOf(atomic_load(&employees.head));
+    while (node != NULL && nodeOf(atomic_load(&node->next)) != NULL)
+    {
+        Node *next = nodeOf(atomic_load(&node->next));
+        errors += compareEmployee(node->data, next->data) >= 0;
+        node = next;
+    }
+
+    destroyLockFreeList(&employees);
+    free(args);
+    return errors;
+}
+
+int main()
+{
+    for (int k = 0; k < KEYS; k++)
+    {
+        snprintf(keys[k].name, sizeof(keys[k].name), "employee%04d", k);
+        keys[k].age = (unsigned char)(k % 100);
+    }
+
+    initializeLockFreeList(&employees, (COMPARE)compareEmployee);
+    insertNode(&employees, &keys[3]);
+    insertNode(&employees, &keys[1]);
+    insertNode(&employees, &keys[2]);
+    deleteNode(&employees, &keys[1]);
+    traverseLockFree(&employees, (DISPLAY)displayEmployee);
+    destroyLockFreeList(&employees);
+
+    long errors = 0;
+    printf("threads\tread-heavy Mops/s\twrite-heavy Mops/s\n");
+    for (int threads = 1; threads <= STRESS_THREADS; threads *= 2)
+    {
+        double readSeconds, writeSeconds;
+        errors += runStress(threads, 90, &readSeconds);
+        errors += runStress(threads, 0, &writeSeconds);
+        printf("%d\t%.2f\t\t\t%.2f\n", threads, OPERATIONS / readSeconds / 1e6, OPERATIONS / writeSeconds / 1e6);
+    }
+    printf("consistency errors: %ld\n", errors);
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*Every operation here is a walk from the head, so the list is still O(n) per operation
+and suits short lists or as the bottom level of a lock-free skip list or hash table. What
+it removes is the serialization: readers never wait, and writers only retry when they
+touch the same pair of nodes at the same moment.*/
@@ -0,0 +1,268 @@
+// A Lock-Free Person Pool
+
+/*The magazines in poolMagazines.c avoid contention by giving each thread its own stacks,
+but they still fall back on a mutex at the depot. A Treiber stack removes the lock
+altogether. The pool is kept as a single-linked stack of free persons, and both get and
+return are a single compare-and-swap on the head of that stack. If another thread
+changed the head in the meantime the compare-and-swap fails and the operation simply
+tries again, so no thread ever waits on another.
+
+The classic trap with this design is the ABA problem. Thread one reads head A and its
+next pointer B, then is delayed. Thread two pops A, pops B, and pushes A back. The head
+is A again, so thread one's compare-and-swap succeeds and installs B as the head even
+though B is now in use. To defeat this, the head holds a generation counter alongside
+the top of the stack, and every successful push or pop increments it. Thread one's stale
+head then differs in its counter and the compare-and-swap fails as it should.
+
+Packing a full pointer and a counter into one word needs a double-width compare-and-swap.
+Instead the persons are preallocated in an array, and the stack is linked by 32-bit
+indexes. The head is a 64-bit value: the counter in the upper half and the index of the
+top slot plus one in the lower half, with zero meaning the stack is empty. Because the
+slots are never freed while the pool exists, a thread that reads the next field of a slot
+another thread has just popped reads valid memory, and the counter discards the result.*/
+
+// Compile with: gcc -O2 -pthread lockFreePool.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+typedef struct person
+{
+    int a;
+    char b;
+} Person;
+
+typedef struct _poolSlot
+{
+    Person person;
+    _Atomic uint32_t next;
+} PoolSlot;
+
+typedef struct _lockFreePool
+{
+    _Alignas(64) _Atomic uint64_t head;
+    PoolSlot *slots;
+    uint32_t capacity;
+} LockFreePool;
+
+#define HEAD_INDEX(head) ((uint32_t)(head))
+#define HEAD_TAG(head) ((head) >> 32)
+#define MAKE_HEAD(tag, index) (((uint64_t)(tag) << 32) | (index))
+
+/*The pool is created with all of its slots already on the stack. Slot i links to slot i + 1
+and the last slot's next field is zero:*/
+
+void initializePool(LockFreePool *pool, uint32_t capacity)
+{
+    pool->slots = (PoolSlot *)malloc(capacity * sizeof(PoolSlot));
+    pool->capacity = capacity;
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+        atomic_init(&pool->slots[i].next, i + 1 < capacity ? i + 2 : 0);
+    }
+    atomic_init(&pool->head, MAKE_HEAD(0, capacity > 0 ? 1 : 0));
+}
+
+void destroyPool(LockFreePool *pool)
+{
+    free(pool->slots);
+    pool->slots = NULL;
+    pool->capacity = 0;
+}
+
+/*getPerson pops the top slot. The compare-and-swap reloads old on failure, so the loop
+recomputes the new head from the latest value. When the stack is empty the pool behaves
+like the one in avoidingOverhead.c and allocates a new Person:*/
+
+Person *getPerson(LockFreePool *pool)
+{
+    uint64_t old = atomic_load_explicit(&pool->head, memory_order_acquire);
+    uint64_t new;
+    uint32_t index;
+    do
+    {
+        index = HEAD_INDEX(old);
+        if (index == 0)
+        {
+            return (Person *)malloc(sizeof(Person));
+        }
+        uint32_t next = atomic_load_explicit(&pool->slots[index - 1].next, memory_order_relaxed);
+        new = MAKE_HEAD(HEAD_TAG(old) + 1, next);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->head, &old, new,
+                                                    memory_order_acquire, memory_order_acquire));
+    return &pool->slots[index - 1].person;
+}
+
+/*returnPerson pushes a slot back. A person that did not come from the slot array was
+allocated by getPerson when the pool was empty, and it is freed instead. The release
+ordering makes the caller's writes to the person visible to whichever thread pops it
+next:*/
+
+void returnPerson(LockFreePool *pool, Person *person)
+{
+    uintptr_t address = (uintptr_t)person;
+    uintptr_t first = (uintptr_t)pool->slots;
+    if (address < first || address >= first + pool->capacity * sizeof(PoolSlot))
+    {
+        free(person);
+        return;
+    }
+    PoolSlot *slot = (PoolSlot *)person;
+    uint32_t index = (uint32_t)(slot - pool->slots) + 1;
+    uint64_t old = atomic_load_explicit(&pool->head, memory_order_relaxed);
+    uint64_t new;
+    do
+    {
+        atomic_store_explicit(&slot->next, HEAD_INDEX(old), memory_order_relaxed);
+        new = MAKE_HEAD(HEAD_TAG(old) + 1, index);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->head, &old, new,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+/*The stress test below runs many threads that each take a handful of persons, hold them
+briefly and give them back. An owner array with one atomic flag per slot catches any
+slot handed to two threads at once: getting a slot sets its flag and the old value must
+be zero, returning clears it. Each thread also writes its id into the person and checks
+it is still there before returning it.
+
+Every 16th round of HELD gets and HELD returns is timed. The samples from all threads
+are sorted to find the 99th percentile latency, and the total number of operations over
+the elapsed time gives the throughput:*/
+
+#define POOL_CAPACITY 4096
+#define HELD 8
+#define OPERATIONS 400000
+#define SAMPLE_EVERY 16
+#define MAX_THREADS 32
+
+typedef struct _stressArgs
+{
+    LockFreePool *pool;
+    atomic_char *owner;
+    atomic_long *errors;
+    int id;
+    long operations;
+    long *samples;
+    long sampleCount;
+} StressArgs;
+
+long elapsedNanoseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
+
+void *stressThread(void *arg)
+{
+    StressArgs *args = (StressArgs *)arg;
+    LockFreePool *pool = args->pool;
+    Person *held[HELD];
+    struct timespec start, end;
+
+    for (long n = 0; n < args->operations; n += HELD)
+    {
+        int sampled = (n / HELD) % SAMPLE_EVERY == 0;
+        if (sampled)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+        }
+        for (int i = 0; i < HELD; i++)
+        {
+            held[i] = getPerson(pool);
+            uintptr_t offset = (uintptr_t)held[i] - (uintptr_t)pool->slots;
+            if (offset < POOL_CAPACITY * sizeof(PoolSlot) &&
+                atomic_exchange(&args->owner[offset / sizeof(PoolSlot)], 1) != 0)
+            {
+                atomic_fetch_add(args->errors, 1);
+            }
+            held[i]->a = args->id;
+        }
+        for (int i = 0; i < HELD; i++)
+        {
+            if (held[i]->a != args->id)
+            {
+                atomic_fetch_add(args->errors, 1);
+            }
+            uintptr_t offset = (uintptr_t)held[i] - (uintptr_t)pool->slots;
+            if (offset < POOL_CAPACITY * sizeof(PoolSlot))
+            {
+                atomic_store(&args->owner[offset / sizeof(PoolSlot)], 0);
+            }
+            returnPerson(pool, held[i]);
+        }
+        if (sampled)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            args->samples[args->sampleCount++] = elapsedNanoseconds(&start, &end);
+        }
+    }
+    return NULL;
+}
+
+int compareLong(const void *a, const void *b)
+{
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+int main()
+{
+    LockFreePool pool;
+    initializePool(&pool, POOL_CAPACITY);
+    atomic_char *owner = (atomic_char *)calloc(POOL_CAPACITY, sizeof(atomic_char));
+    atomic_long errors = 0;
+
+    printf("threads\tMops/s\tp99 ns (get+return of %d)\n", HELD);
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2)
+    {
+        pthread_t ids[MAX_THREADS];
+        StressArgs args[MAX_THREADS];
+        long perThread = OPERATIONS / threads;
+        long maxSamples = perThread / HELD / SAMPLE_EVERY + 1;
+        long *samples = (long *)malloc(threads * maxSamples * sizeof(long));
+        struct timespec start, end;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int t = 0; t < threads; t++)
+        {
+            args[t] = (StressArgs){&pool, owner, &errors, t, perThread, samples + t * maxSamples, 0};
+            pthread_create(&ids[t], NULL, stressThread, &args[t]);
+        }
+        for (int t = 0; t < threads; t++)
+        {
+            pthread_join(ids[t], NULL);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        // Pack the per-thread samples together before sorting them
+        long count = 0;
+        for (int t = 0; t < threads; t++)
+        {
+            for (long s = 0; s < args[t].sampleCount; s++)
+            {
+                samples[count++] = args[t].samples[s];
+            }
+        }
+        qsort(samples, count, sizeof(long), compareLong);
+
+        // Each loop iteration performs HELD gets and HELD returns
+        double operations = 2.0 * perThread * threads;
+        double seconds = elapsedNanoseconds(&start, &end) / 1e9;
+        printf("%d\t%.2f\t%ld\n", threads, operations / seconds / 1e6,
+               count > 0 ? samples[count * 99 / 100] : 0L);
+        free(samples);
+    }
+    printf("double hand-outs or corrupted persons: %ld\n", (long)errors);
+
+    free(owner);
+    destroyPool(&pool);
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*On a single core the threads mostly take turns, so the numbers mainly show the cost of
+the atomic instructions. On a multicore machine the head's cache line moves between
+cores on every operation, which is why Treiber stacks are usually combined with
+per-thread caches like the magazines when throughput matters more than simplicity.*/
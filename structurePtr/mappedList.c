@@ -0,0 +1,413 @@
+// A Memory-Mapped Employee List
+
+/*Loading a saved list node by node means one read, one allocation, and one link per
+employee, so startup time grows with the size of the list. If the file already holds the
+list in the form it is used in memory, it can instead be mapped with mmap and traversed
+at once. The operating system brings pages in only as the traversal touches them.
+
+Pointers cannot be stored in such a file, because the mapping lands at a different
+address each time. The image therefore links its nodes with offsets from the start of the
+file. Turning an offset into a pointer is a single addition to the mapping's base, so the
+same bytes work wherever they are mapped. An offset of zero marks the end of the list,
+since the header always occupies the start of the file.
+
+The image holds the employees themselves inside the nodes, rather than pointers to them,
+so one mapping covers everything:*/
+
+// Compile with: gcc -O2 mappedList.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+typedef void (*DISPLAY)(void *);
+
+void displayEmployee(Employee *employee)
+{
+    printf("%s\t%d\n", employee->name, employee->age);
+}
+
+typedef struct _node
+{
+    void *data;
+    struct _node *next;
+} Node;
+
+typedef struct _linkedList
+{
+    Node *head;
+    Node *tail;
+    Node *current;
+} LinkedList;
+
+/*The header identifies the file and records the layout it was written with. A reader
+refuses an image whose version or node size does not match its own, instead of
+misreading it. fileSize lets the reader check the file was not truncated:*/
+
+#define IMAGE_MAGIC "EMPLIST"
+#define IMAGE_VERSION 1
+
+typedef struct _imageHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeSize;
+    uint64_t count;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t fileSize;
+} ImageHeader;
+
+typedef struct _imageNode
+{
+    uint64_t next;
+    Employee employee;
+} ImageNode;
+
+/*saveListImage writes the list in traversal order, so each node's next offset is simply
+the offset of the node written after it. Writing in order also keeps a traversal of the
+mapped file sequential, which is the access pattern the kernel's read-ahead handles best:*/
+
+int saveListImage(LinkedList *list, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    ImageHeader header = {IMAGE_MAGIC, IMAGE_VERSION, sizeof(ImageNode), 0, 0, 0, 0};
+    for (Node *node = list->head; node != NULL; node = node->next)
+    {
+        header.count++;
+    }
+    if (header.count > 0)
+    {
+        header.head = sizeof(ImageHeader);
+        header.tail = sizeof(ImageHeader) + (header.count - 1) * sizeof(ImageNode);
+    }
+    header.fileSize = sizeof(ImageHeader) + header.count * sizeof(ImageNode);
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    uint64_t offset = sizeof(ImageHeader);
+    for (Node *node = list->head; ok && node != NULL; node = node->next)
+    {
+        ImageNode image;
+        memset(&image, 0, sizeof(image));
+        offset += sizeof(ImageNode);
+        image.next = node->next != NULL ? offset : 0;
+        image.employee = *(Employee *)node->data;
+        ok = fwrite(&image, sizeof(image), 1, file) == 1;
+    }
+    if (fclose(file) != 0 || !ok)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*A ListImage is an open mapping. Two modes are offered. IMAGE_READ_ONLY maps the file
+shared and read-only, so any number of processes can share the same physical pages.
+IMAGE_COPY_ON_WRITE maps it private and writable: edits are made in place in memory, the
+kernel copies only the pages that are actually modified, and the file is never changed.
+The edits disappear when the image is closed:*/
+
+#define IMAGE_READ_ONLY 0
+#define IMAGE_COPY_ON_WRITE 1
+
+typedef struct _listImage
+{
+    char *base;
+    size_t size;
+    ImageHeader *header;
+} ListImage;
+
+/*openListImage does the same amount of work for a list of ten employees or ten million.
+It maps the file and checks the header, and touches nothing else:*/
+
+int openListImage(ListImage *image, const char *path, int mode)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(ImageHeader))
+    {
+        close(fd);
+        return -1;
+    }
+    int protection = mode == IMAGE_COPY_ON_WRITE ? PROT_READ | PROT_WRITE : PROT_READ;
+    int flags = mode == IMAGE_COPY_ON_WRITE ? MAP_PRIVATE : MAP_SHARED;
+    void *base = mmap(NULL, status.st_size, protection, flags, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    ImageHeader *header = (ImageHeader *)base;
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != IMAGE_VERSION || header->nodeSize != sizeof(ImageNode) ||
+        header->fileSize != (uint64_t)status.st_size ||
+        header->count > (header->fileSize - sizeof(ImageHeader)) / sizeof(ImageNode))
+    {
+        munmap(base, status.st_size);
+        return -1;
+    }
+    image->base = (char *)base;
+    image->size = status.st_size;
+    image->header = header;
+    return 0;
+}
+
+void closeListImage(ListImage *image)
+{
+    munmap(image->base, image->size);
+    image->base = NULL;
+    image->header = NULL;
+    image->size = 0;
+}
+
+/*resolveNode turns an offset into a node pointer. Since the file may come from anywhere,
+the offset is checked before it is used: it must lie on a node boundary inside the
+mapping. A bad offset ends the traversal instead of reading outside the file:*/
+
+ImageNode *resolveNode(ListImage *image, uint64_t offset)
+{
+    if (offset < sizeof(ImageHeader) || offset > image->size - sizeof(ImageNode) ||
+        (offset - sizeof(ImageHeader)) % sizeof(ImageNode) != 0)
+    {
+        return NULL;
+    }
+    return (ImageNode *)(image->base + offset);
+}
+
+ImageNode *imageHead(ListImage *image)
+{
+    return resolveNode(image, image->header->head);
+}
+
+ImageNode *imageNext(ListImage *image, ImageNode *node)
+{
+    return resolveNode(image, node->next);
+}
+
+uint64_t offsetOf(ListImage *image, ImageNode *node)
+{
+    return (uint64_t)((char *)node - image->base);
+}
+
+/*Traversal works just like the pointer-based list, with imageNext taking the place of the
+next pointer. A count guards against a corrupted file whose links form a cycle:*/
+
+void traverseImage(ListImage *image, DISPLAY display)
+{
+    uint64_t remaining = image->header->count;
+    for (ImageNode *node = imageHead(image); node != NULL && remaining > 0; node = imageNext(image, node))
+    {
+        display(&node->employee);
+        remaining--;
+    }
+}
+
+/*In copy-on-write mode the image can be edited like any list. unlinkImageNode removes a
+node by rewriting its predecessor's offset, exactly as delete does with pointers in
+Linkedlist.c. The node itself stays in the mapping but is no longer reachable:*/
+
+void unlinkImageNode(ListImage *image, ImageNode *node)
+{
+    ImageHeader *header = image->header;
+    uint64_t offset = offsetOf(image, node);
+    if (header->head == offset)
+    {
+        header->head = node->next;
+        if (header->tail == offset)
+        {
+            header->tail = 0;
+        }
+    }
+    else
+    {
+        ImageNode *previous = imageHead(image);
+        while (previous != NULL && previous->next != offset)
+        {
+            previous = imageNext(image, previous);
+        }
+        if (previous == NULL)
+        {
+            return;
+        }
+        previous->next = node->next;
+        if (header->tail == offset)
+        {
+            header->tail = offsetOf(image, previous);
+        }
+    }
+    header->count--;
+}
+
+/*The benchmark compares two ways of starting up with a saved list of N employees. The
+first reads the file record by record and rebuilds an ordinary linked list with malloc.
+The second maps the image. Both are timed to the point where the first employee can be
+used, and then for a full traversal that sums the ages. The sizes grow a hundredfold
+each step, which makes it plain which startup time depends on N:*/
+
+double elapsedMilliseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void buildList(LinkedList *list, Employee *employees, Node *nodes, long count)
+{
+    for (long i = 0; i < count; i++)
+    {
+        snprintf(employees[i].name, sizeof(employees[i].name), "employee%ld", i);
+        employees[i].age = (unsigned char)(20 + i % 50);
+        nodes[i].data = &employees[i];
+        nodes[i].next = i + 1 < count ? &nodes[i + 1] : NULL;
+    }
+    list->head = count > 0 ? &nodes[0] : NULL;
+    list->tail = count > 0 ? &nodes[count - 1] : NULL;
+    list->current = NULL;
+}
+
+long rebuildFromFile(const char *path, LinkedList *list)
+{
+    FILE *file = fopen(path, "rb");
+    ImageHeader header;
+    if (file == NULL)
+    {
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1)
+    {
+        fclose(file);
+        return -1;
+    }
+    list->head = list->tail = NULL;
+    ImageNode image;
+    long count = 0;
+    while (fread(&image, sizeof(image), 1, file) == 1)
+    {
+        Employee *employee = (Employee *)malloc(sizeof(Employee));
+        Node *node = (Node *)malloc(sizeof(Node));
+        *employee = image.employee;
+        node->data = employee;
+        node->next = NULL;
+        if (list->head == NULL)
+        {
+            list->head = node;
+        }
+        else
+        {
+            list->tail->next = node;
+        }
+        list->tail = node;
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+void freeRebuiltList(LinkedList *list)
+{
+    while (list->head != NULL)
+    {
+        Node *next = list->head->next;
+        free(list->head->data);
+        free(list->head);
+        list->head = next;
+    }
+}
+
+int main()
+{
+    const char *path = "employees.img";
+    long sizes[] = {1000, 100000, 10000000};
+    printf("employees\trebuild ms\tmmap ms\t\trebuild+walk\tmmap+walk\n");
+    for (int s = 0; s < 3; s++)
+    {
+        long count = sizes[s];
+        Employee *employees = (Employee *)malloc(count * sizeof(Employee));
+        Node *nodes = (Node *)malloc(count * sizeof(Node));
+        LinkedList list;
+        buildList(&list, employees, nodes, count);
+        if (saveListImage(&list, path) != 0)
+        {
+            printf("could not write %s\n", path);
+            return 1;
+        }
+        free(nodes);
+        free(employees);
+
+        struct timespec start, loaded, walked;
+        LinkedList rebuilt;
+        long ages = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        rebuildFromFile(path, &rebuilt);
+        clock_gettime(CLOCK_MONOTONIC, &loaded);
+        for (Node *node = rebuilt.head; node != NULL; node = node->next)
+        {
+            ages += ((Employee *)node->data)->age;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &walked);
+        double rebuildLoad = elapsedMilliseconds(&start, &loaded);
+        double rebuildWalk = elapsedMilliseconds(&start, &walked);
+        freeRebuiltList(&rebuilt);
+
+        ListImage image;
+        long mappedAges = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (openListImage(&image, path, IMAGE_READ_ONLY) != 0)
+        {
+            printf("could not map %s\n", path);
+            return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &loaded);
+        for (ImageNode *node = imageHead(&image); node != NULL; node = imageNext(&image, node))
+        {
+            mappedAges += node->employee.age;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &walked);
+        closeListImage(&image);
+        printf("%ld\t%s%.3f\t\t%.3f\t\t%.1f\t\t%.1f%s\n", count, count < 10000000 ? "\t" : "", rebuildLoad,
+               elapsedMilliseconds(&start, &loaded), rebuildWalk, elapsedMilliseconds(&start, &walked),
+               ages == mappedAges ? "" : "\tMISMATCH");
+    }
+
+    /*Copy-on-write: remove the first employee and change the second one's age in a private
+    mapping, then map the file again read-only to show it was not modified:*/
+    ListImage edited, original;
+    openListImage(&edited, path, IMAGE_COPY_ON_WRITE);
+    ImageNode *first = imageHead(&edited);
+    ImageNode *second = imageNext(&edited, first);
+    second->employee.age = 99;
+    unlinkImageNode(&edited, first);
+    openListImage(&original, path, IMAGE_READ_ONLY);
+    printf("\nedited copy:   %llu employees, first is ", (unsigned long long)edited.header->count);
+    displayEmployee(&imageHead(&edited)->employee);
+    printf("file on disk:  %llu employees, first is ", (unsigned long long)original.header->count);
+    displayEmployee(&imageHead(&original)->employee);
+    closeListImage(&original);
+    closeListImage(&edited);
+    unlink(path);
+    return 0;
+}
+
+/*The mapped image is ready in a few microseconds at every size, while rebuilding grows
+with the list. The cost of reading the records does not vanish: the first traversal of a
+mapping takes page faults as it goes, and a file that is not in the page cache must still
+be read from disk. What disappears is the parsing, the allocation, and the wait before the
+first employee can be used.*/
@@ -0,0 +1,202 @@
+// Comparing Fixed-Width Names with SIMD
+
+/*compareEmployee in Linkedlist.c calls strcmp, which walks both names a byte at a time
+until they differ or one of them ends. The name field, however, is always a 32-byte
+array. If every byte after the terminating NUL is also zero, two names can be compared
+as two 32-byte blocks without looking for the end at all.
+
+With that guarantee, SIMD instructions compare all 32 bytes at once. An equality compare
+produces a mask with one bit per byte, set where the bytes are equal. If every bit is
+set the names are equal. Otherwise the lowest clear bit is the first byte where they
+differ, found with a single count-trailing-zeros instruction, and comparing those two
+bytes as unsigned characters gives the same order strcmp would. Bytes after the NUL do
+not disturb the result, since both names are zero there.
+
+The guarantee is provided by initializeEmployee, which clears the whole name before
+copying into it. Every Employee compared with these functions must be created this way,
+or zeroed with calloc or memset first.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <immintrin.h>
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+typedef int (*COMPARE)(void *, void *);
+
+int compareEmployee(Employee *e1, Employee *e2)
+{
+    return strcmp(e1->name, e2->name);
+}
+
+/*initializeEmployee is the padded-name constructor. Names longer than 31 characters are
+truncated so the array always ends in at least one zero byte:*/
+
+void initializeEmployee(Employee *employee, const char *name, unsigned char age)
+{
+    size_t length = strnlen(name, sizeof(employee->name) - 1);
+    memset(employee->name, 0, sizeof(employee->name));
+    memcpy(employee->name, name, length);
+    employee->age = age;
+}
+
+/*The SSE2 version compares the name in two 16-byte halves and joins the two masks into one
+32-bit value. The AVX2 version does it in one 32-byte compare. The name field sits at an
+arbitrary offset in memory, so both use unaligned loads:*/
+
+__attribute__((target("sse2"))) int compareEmployeeSSE2(Employee *e1, Employee *e2)
+{
+    __m128i a0 = _mm_loadu_si128((const __m128i *)e1->name);
+    __m128i b0 = _mm_loadu_si128((const __m128i *)e2->name);
+    __m128i a1 = _mm_loadu_si128((const __m128i *)(e1->name + 16));
+    __m128i b1 = _mm_loadu_si128((const __m128i *)(e2->name + 16));
+    uint32_t equal = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a0, b0)) |
+                     (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a1, b1)) << 16;
+    uint32_t differ = ~equal;
+    if (differ == 0)
+    {
+        return 0;
+    }
+    int index = __builtin_ctz(differ);
+    return (unsigned char)e1->name[index] - (unsigned char)e2->name[index];
+}
+
+__attribute__((target("avx2"))) int compareEmployeeAVX2(Employee *e1, Employee *e2)
+{
+    __m256i a = _mm256_loadu_si256((const __m256i *)e1->name);
+    __m256i b = _mm256_loadu_si256((const __m256i *)e2->name);
+    uint32_t differ = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+    if (differ == 0)
+    {
+        return 0;
+    }
+    int index = __builtin_ctz(differ);
+    return (unsigned char)e1->name[index] - (unsigned char)e2->name[index];
+}
+
+/*When only equality matters, as in a search by exact name, there is no need to locate the
+first difference. Four 64-bit words XORed together do the job on any processor, and the
+compiler turns the whole function into a handful of instructions:*/
+
+int equalEmployeeNames(Employee *e1, Employee *e2)
+{
+    uint64_t a[4], b[4];
+    memcpy(a, e1->name, sizeof(a));
+    memcpy(b, e2->name, sizeof(b));
+    return ((a[0] ^ b[0]) | (a[1] ^ b[1]) | (a[2] ^ b[2]) | (a[3] ^ b[3])) == 0;
+}
+
+/*compareEmployeePadded is bound once to the best version the processor supports, and is
+used wherever compareEmployee was, for example as the COMPARE function of a list:*/
+
+COMPARE compareEmployeePadded = (COMPARE)compareEmployeeSSE2;
+
+void chooseComparator()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        compareEmployeePadded = (COMPARE)compareEmployeeAVX2;
+    }
+}
+
+/*The benchmark sorts a million employees with qsort and then searches for names, once
+with each comparator. The names share the prefix "employee", so strcmp has to get through
+at least eight equal bytes before it finds a difference. qsort passes pointers to the
+array elements, so small adapters unpack them:*/
+
+#define EMPLOYEES 1000000
+#define SEARCHES 200
+
+COMPARE sortCompare;
+
+int compareForQsort(const void *a, const void *b)
+{
+    return sortCompare(*(Employee *const *)a, *(Employee *const *)b);
+}
+
+int sign(int value)
+{
+    return (value > 0) - (value < 0);
+}
+
+double elapsedMilliseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int main()
+{
+    chooseComparator();
+    Employee *employees = (Employee *)malloc(EMPLOYEES * sizeof(Employee));
+    Employee **order = (Employee **)malloc(EMPLOYEES * sizeof(Employee *));
+    unsigned long state = 11;
+    for (int i = 0; i < EMPLOYEES; i++)
+    {
+        char name[40];
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        snprintf(name, sizeof(name), "employee%lu", (state >> 33) % 100000000);
+        initializeEmployee(&employees[i], name, (unsigned char)(i % 100));
+    }
+
+    // The SIMD comparators must order every pair exactly as strcmp does
+    int disagreements = 0;
+    for (int i = 0; i + 1 < EMPLOYEES; i++)
+    {
+        int expected = sign(compareEmployee(&employees[i], &employees[i + 1]));
+        disagreements += sign(compareEmployeeSSE2(&employees[i], &employees[i + 1])) != expected;
+        disagreements += sign(compareEmployeePadded(&employees[i], &employees[i + 1])) != expected;
+        disagreements += equalEmployeeNames(&employees[i], &employees[i + 1]) != (expected == 0);
+    }
+    printf("disagreements with strcmp: %d\n", disagreements);
+
+    COMPARE comparators[] = {(COMPARE)compareEmployee, (COMPARE)compareEmployeeSSE2, compareEmployeePadded};
+    const char *names[] = {"strcmp", "SSE2", "best"};
+    for (int c = 0; c < 3; c++)
+    {
+        struct timespec start, end;
+        for (int i = 0; i < EMPLOYEES; i++)
+        {
+            order[i] = &employees[i];
+        }
+        sortCompare = comparators[c];
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        qsort(order, EMPLOYEES, sizeof(Employee *), compareForQsort);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double sortMs = elapsedMilliseconds(&start, &end);
+
+        int found = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int s = 0; s < SEARCHES; s++)
+        {
+            Employee *key = &employees[(s * 7919) % EMPLOYEES];
+            for (int i = 0; i < EMPLOYEES; i++)
+            {
+                if (comparators[c](&employees[i], key) == 0)
+                {
+                    found++;
+                    break;
+                }
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("%-6s sort %7.1f ms, search %6.3f ms per name (%d found)\n", names[c], sortMs,
+               elapsedMilliseconds(&start, &end) / SEARCHES, found);
+    }
+
+    free(order);
+    free(employees);
+    return 0;
+}
+
+/*The SIMD comparators do the same amount of work for every pair of names, whether they
+differ in the first byte or the last, while strcmp stops early on names that differ
+near the start. The gain is therefore largest for names with long common prefixes, and
+equalEmployeeNames is the cheapest choice for exact-match searches.*/
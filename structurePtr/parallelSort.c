@@ -0,0 +1,383 @@
+// Sorting a Linked List in Parallel
+
+/*Merge sort suits linked lists well. Merging two sorted lists only needs to relink their
+nodes, so no elements are copied and no extra array is allocated, however large the
+elements are. It is also stable: nodes that compare equal keep their original order.
+
+To use several threads, the list is cut into as many runs as there are threads, and each
+thread sorts its own run. The sorted runs are then merged in pairs, and the pairs of
+pairs, until one list remains. The merges at each round are independent, so they also
+run in parallel, although the last merge is done by one thread alone. Threads take their
+work from a small thread pool, created once and reused for every task.*/
+
+// Compile with: gcc -O2 -pthread parallelSort.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+typedef int (*COMPARE)(void *, void *);
+
+int compareEmployee(Employee *e1, Employee *e2)
+{
+    return strcmp(e1->name, e2->name);
+}
+
+typedef struct _node
+{
+    void *data;
+    struct _node *next;
+} Node;
+
+typedef struct _linkedList
+{
+    Node *head;
+    Node *tail;
+    Node *current;
+} LinkedList;
+
+/*mergeRuns merges two sorted NULL-terminated chains and returns the head of the result.
+The dummy node saves a special case for the first node. Taking from the left run when
+the two compare equal is what keeps the sort stable:*/
+
+Node *mergeRuns(Node *left, Node *right, COMPARE compare)
+{
+    Node dummy;
+    Node *tail = &dummy;
+    while (left != NULL && right != NULL)
+    {
+        if (compare(right->data, left->data) < 0)
+        {
+            tail->next = right;
+            right = right->next;
+        }
+        else
+        {
+            tail->next = left;
+            left = left->next;
+        }
+        tail = tail->next;
+    }
+    tail->next = left != NULL ? left : right;
+    return dummy.next;
+}
+
+/*sortRun sorts one chain without recursion. Each node is detached and merged into
+bins[0]. When bins[i] is occupied, the two runs of 2^i nodes are merged and carried into
+bins[i + 1], exactly like adding one to a binary counter. At the end the bins are merged
+from the smallest up. Sixty-four bins are enough for any list that fits in memory:*/
+
+Node *sortRun(Node *head, COMPARE compare)
+{
+    Node *bins[64] = {NULL};
+    int used = 0;
+    while (head != NULL)
+    {
+        Node *run = head;
+        head = head->next;
+        run->next = NULL;
+        int i = 0;
+        while (i < used && bins[i] != NULL)
+        {
+            run = mergeRuns(bins[i], run, compare);
+            bins[i] = NULL;
+            i++;
+        }
+        if (i == used)
+        {
+            used++;
+        }
+        bins[i] = run;
+    }
+    Node *result = NULL;
+    for (int i = 0; i < used; i++)
+    {
+        if (bins[i] != NULL)
+        {
+            result = result == NULL ? bins[i] : mergeRuns(bins[i], result, compare);
+        }
+    }
+    return result;
+}
+
+/*The thread pool keeps its workers waiting on a condition variable. A task is a function
+and its argument placed in a fixed ring of slots. waitForTasks blocks until every task
+submitted so far has finished, which separates one round of merging from the next:*/
+
+#define MAX_THREADS 32
+#define MAX_TASKS 64
+
+typedef void (*TASK)(void *);
+
+typedef struct _threadPool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t done;
+    TASK tasks[MAX_TASKS];
+    void *arguments[MAX_TASKS];
+    int first;
+    int queued;
+    int running;
+    int stopping;
+    int threadCount;
+    pthread_t threads[MAX_THREADS];
+} ThreadPool;
+
+void *poolWorker(void *arg)
+{
+    ThreadPool *pool = (ThreadPool *)arg;
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (pool->queued == 0 && !pool->stopping)
+        {
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        }
+        if (pool->queued == 0)
+        {
+            break;
+        }
+        TASK task = pool->tasks[pool->first];
+        void *argument = pool->arguments[pool->first];
+        pool->first = (pool->first + 1) % MAX_TASKS;
+        pool->queued--;
+        pool->running++;
+        pthread_mutex_unlock(&pool->lock);
+
+        task(argument);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->running--;
+        if (pool->queued == 0 && pool->running == 0)
+        {
+            pthread_cond_broadcast(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+void initializeThreadPool(ThreadPool *pool, int threads)
+{
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->ready, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->first = 0;
+    pool->queued = 0;
+    pool->running = 0;
+    pool->stopping = 0;
+    pool->threadCount = threads;
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_create(&pool->threads[i], NULL, poolWorker, pool);
+    }
+}
+
+void submitTask(ThreadPool *pool, TASK task, void *argument)
+{
+    pthread_mutex_lock(&pool->lock);
+    int slot = (pool->first + pool->queued) % MAX_TASKS;
+    pool->tasks[slot] = task;
+    pool->arguments[slot] = argument;
+    pool->queued++;
+    pthread_cond_signal(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void waitForTasks(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->queued > 0 || pool->running > 0)
+    {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void destroyThreadPool(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->threadCount; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->ready);
+    pthread_cond_destroy(&pool->done);
+}
+
+/*Each task works on a SortJob. A sort task sorts runs[index], and a merge task merges
+runs[index] with runs[index + width] into runs[index]:*/
+
+typedef struct _sortJob
+{
+    Node **runs;
+    int index;
+    int width;
+    COMPARE compare;
+} SortJob;
+
+void sortTask(void *arg)
+{
+    SortJob *job = (SortJob *)arg;
+    job->runs[job->index] = sortRun(job->runs[job->index], job->compare);
+}
+
+void mergeTask(void *arg)
+{
+    SortJob *job = (SortJob *)arg;
+    job->runs[job->index] = mergeRuns(job->runs[job->index], job->runs[job->index + job->width], job->compare);
+    job->runs[job->index + job->width] = NULL;
+}
+
+/*sortList counts the nodes, cuts the list into one run per thread, sorts the runs in
+parallel, and then merges neighbouring runs in rounds until one is left. Runs are merged
+left with right, so equal elements stay in their original order. The tail pointer is
+found again at the end, since the last node of the list will usually have moved:*/
+
+void sortList(LinkedList *list, COMPARE compare, ThreadPool *pool)
+{
+    size_t count = 0;
+    for (Node *node = list->head; node != NULL; node = node->next)
+    {
+        count++;
+    }
+    int runCount = pool->threadCount;
+    if ((size_t)runCount > count)
+    {
+        runCount = count > 0 ? (int)count : 1;
+    }
+
+    Node *runs[MAX_THREADS];
+    SortJob jobs[MAX_THREADS];
+    Node *node = list->head;
+    for (int r = 0; r < runCount; r++)
+    {
+        size_t length = count / runCount + ((size_t)r < count % runCount);
+        runs[r] = node;
+        for (size_t i = 1; i < length; i++)
+        {
+            node = node->next;
+        }
+        if (node != NULL)
+        {
+            Node *next = node->next;
+            node->next = NULL;
+            node = next;
+        }
+    }
+
+    for (int r = 0; r < runCount; r++)
+    {
+        jobs[r] = (SortJob){runs, r, 0, compare};
+        submitTask(pool, sortTask, &jobs[r]);
+    }
+    waitForTasks(pool);
+
+    for (int width = 1; width < runCount; width *= 2)
+    {
+        for (int r = 0; r + width < runCount; r += 2 * width)
+        {
+            jobs[r] = (SortJob){runs, r, width, compare};
+            submitTask(pool, mergeTask, &jobs[r]);
+        }
+        waitForTasks(pool);
+    }
+
+    list->head = runs[0];
+    list->tail = runs[0];
+    while (list->tail != NULL && list->tail->next != NULL)
+    {
+        list->tail = list->tail->next;
+    }
+    list->current = NULL;
+}
+
+/*The benchmark sorts the same shuffled list of employees with 1 to 32 threads. Before
+each sort the list is relinked in the same shuffled order, so every thread count sorts
+identical input. The number of employees defaults to two million and can be given on
+the command line:*/
+
+double elapsedMilliseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    long count = argc > 1 ? atol(argv[1]) : 2000000;
+    Employee *employees = (Employee *)malloc(count * sizeof(Employee));
+    Node *nodes = (Node *)malloc(count * sizeof(Node));
+    long *order = (long *)malloc(count * sizeof(long));
+    unsigned long state = 42;
+    for (long i = 0; i < count; i++)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        snprintf(employees[i].name, sizeof(employees[i].name), "employee%08lu", (state >> 33) % 100000000);
+        employees[i].age = (unsigned char)(i % 100);
+        nodes[i].data = &employees[i];
+        order[i] = i;
+    }
+    for (long i = count - 1; i > 0; i--)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        long j = (long)((state >> 33) % (unsigned long)(i + 1));
+        long swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    double single = 0;
+    printf("threads\tms\tspeedup\n");
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2)
+    {
+        LinkedList list;
+        for (long i = 0; i < count - 1; i++)
+        {
+            nodes[order[i]].next = &nodes[order[i + 1]];
+        }
+        nodes[order[count - 1]].next = NULL;
+        list.head = &nodes[order[0]];
+        list.tail = &nodes[order[count - 1]];
+
+        ThreadPool pool;
+        initializeThreadPool(&pool, threads);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        sortList(&list, (COMPARE)compareEmployee, &pool);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        destroyThreadPool(&pool);
+
+        long sorted = 1;
+        for (Node *node = list.head; node->next != NULL; node = node->next)
+        {
+            sorted += compareEmployee(node->data, node->next->data) <= 0;
+        }
+        double ms = elapsedMilliseconds(&start, &end);
+        if (threads == 1)
+        {
+            single = ms;
+        }
+        printf("%d\t%.1f\t%.2fx%s\n", threads, ms, single / ms, sorted == count ? "" : "\tNOT SORTED");
+    }
+
+    free(order);
+    free(nodes);
+    free(employees);
+    return 0;
+}
+
+/*The single-threaded row is an ordinary merge sort, since with one run there is nothing
+to merge afterwards. The speedup is limited by the final merge, which touches every node
+on one thread, and by memory bandwidth once every core is chasing pointers at once.*/
@@ -0,0 +1,313 @@
+// Benchmarking Allocation Strategies
+
+/*Whether a pool pays off depends on the structure and on how it is used. The pool in
+avoidingOverhead.c saves the cost of malloc and free, but a small object held briefly by
+one thread may already be cheap to allocate, and a large object may cost more to touch
+than to allocate. This program measures three strategies under the same workload so the
+choice can be made per structure:
+
+    malloc   every object comes from malloc and goes back with free
+    pool     the pool from avoidingOverhead.c, with its watermarks and epochs
+    arena    a bump allocator that hands out consecutive pieces of one large block and
+             releases them all at once by resetting its offset
+
+The workload is a series of rounds. In each round a thread obtains a working set of
+objects, writes to the first and last byte of each one, and releases them all. The
+object size runs from 8 bytes to 4 KiB, the working set from 16 to 16384 objects, and
+the thread count from 1 to 8. Each thread has its own pool and its own arena, because
+neither is thread safe; malloc is shared, as it is in a real program.
+
+For each run the program reports the time per get and release pair, the last-level
+cache misses per pair, and the resident set size while the working sets are held. Cache
+misses come from the Linux perf_event_open interface. Where it is not available, for
+example inside a container without perf access, the column shows n/a.
+
+The pool is not copied here. avoidingOverhead.c is included with its demo main left out,
+so the benchmark runs the same poolGet and poolReturn as any other user of the pool.
+POOL_STATS is set explicitly, to the pool's default of 0 unless it is given on the
+command line, and the first line of the output says which was measured.*/
+
+// Compile with: gcc -O2 -pthread poolBenchmark.c, adding -DPOOL_STATS=1 to include the pool's statistics
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#ifndef POOL_STATS
+#define POOL_STATS 0
+#endif
+#define POOL_NO_MAIN
+#include "avoidingOverhead.c"
+
+#define MIN_OBJECT 8
+#define MAX_OBJECT 4096
+#define MAX_THREADS 8
+#define OPERATIONS_PER_THREAD 1000000
+#define MAX_BYTES_PER_THREAD (64u << 20)
+
+int workingSets[] = {16, 1024, 16384};
+
+enum
+{
+    STRATEGY_MALLOC,
+    STRATEGY_POOL,
+    STRATEGY_ARENA
+};
+const char *strategyNames[] = {"malloc", "pool", "arena"};
+
+/*The arena is as simple as an allocator can be. arenaGet rounds the offset up to a
+16-byte boundary and advances it, and arenaReset releases everything by setting the offset
+back to zero:*/
+
+typedef struct _arena
+{
+    char *base;
+    size_t offset;
+    size_t size;
+} Arena;
+
+void *arenaGet(Arena *arena, size_t size)
+{
+    size_t start = (arena->offset + 15) & ~(size_t)15;
+    if (start + size > arena->size)
+    {
+        return NULL;
+    }
+    arena->offset = start + size;
+    return arena->base + start;
+}
+
+void arenaReset(Arena *arena)
+{
+    arena->offset = 0;
+}
+
+/*Each thread runs rounds until it has performed its share of operations. After the last
+round it fills its working set once more and waits at a barrier so the main thread can
+read the resident set size with every working set live, then releases it and exits.
+
+The pool starts empty with a high watermark of one working set. The first round misses
+on every get and grows the pool, and from then on every get should be served from the
+list. A pool that kept freeing and reallocating would still produce a plausible time,
+so each thread counts the gets that found the list non-empty and the output reports the
+pool's hit rate next to its time. Only the first round should miss. A 16384-object working
+set runs 62 rounds, so its best possible hit rate is 61/62, or 98.4%:*/
+
+typedef struct _run
+{
+    int strategy;
+    size_t objectSize;
+    int workingSet;
+    atomic_long poolHits;
+    pthread_barrier_t held;
+    pthread_barrier_t measured;
+} Run;
+
+void touch(char *object, size_t size)
+{
+    object[0] = 1;
+    object[size - 1] = 1;
+}
+
+void *benchmarkThread(void *arg)
+{
+    Run *run = (Run *)arg;
+    size_t size = run->objectSize;
+    int count = run->workingSet;
+    void **objects = (void **)malloc(count * sizeof(void *));
+    Pool pool;
+    initializePool(&pool, size, 0, count);
+    Arena arena = {NULL, 0, count * ((size + 15) & ~(size_t)15)};
+    if (run->strategy == STRATEGY_ARENA)
+    {
+        arena.base = (char *)malloc(arena.size);
+    }
+
+    long hits = 0;
+    long rounds = OPERATIONS_PER_THREAD / count;
+    for (long r = 0; r <= rounds; r++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            switch (run->strategy)
+            {
+            case STRATEGY_MALLOC:
+                objects[i] = malloc(size);
+                break;
+            case STRATEGY_POOL:
+                hits += pool.count > 0;
+                objects[i] = poolGet(&pool);
+                break;
+            default:
+                objects[i] = arenaGet(&arena, size);
+            }
+            touch((char *)objects[i], size);
+        }
+        if (r == rounds)
+        {
+            pthread_barrier_wait(&run->held);
+            pthread_barrier_wait(&run->measured);
+        }
+        switch (run->strategy)
+        {
+        case STRATEGY_MALLOC:
+            for (int i = 0; i < count; i++)
+            {
+                free(objects[i]);
+            }
+            break;
+        case STRATEGY_POOL:
+            for (int i = 0; i < count; i++)
+            {
+                poolReturn(&pool, objects[i]);
+            }
+            break;
+        default:
+            arenaReset(&arena);
+        }
+    }
+
+    atomic_fetch_add(&run->poolHits, hits);
+    destroyPool(&pool);
+    free(arena.base);
+    free(objects);
+    return NULL;
+}
+
+/*The cache miss counter is opened with inherit set, so it also counts the threads the run
+creates after it is opened. It is read when every thread has its final working set
+held, which excludes the teardown from the count:*/
+
+int openCacheMissCounter()
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+long residentKilobytes()
+{
+    long pages = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL)
+    {
+        if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+        {
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void runBenchmark(int strategy, size_t objectSize, int workingSet, int threads)
+{
+    pthread_t ids[MAX_THREADS];
+    Run run = {.strategy = strategy, .objectSize = objectSize, .workingSet = workingSet};
+    struct timespec start, end;
+    long long misses = -1;
+
+    pthread_barrier_init(&run.held, NULL, threads + 1);
+    pthread_barrier_init(&run.measured, NULL, threads + 1);
+    int counter = openCacheMissCounter();
+    if (counter >= 0)
+    {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_create(&ids[t], NULL, benchmarkThread, &run);
+    }
+    pthread_barrier_wait(&run.held);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (counter >= 0)
+    {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &misses, sizeof(misses)) != sizeof(misses))
+        {
+            misses = -1;
+        }
+        close(counter);
+    }
+    long rss = residentKilobytes();
+    pthread_barrier_wait(&run.measured);
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_join(ids[t], NULL);
+    }
+    pthread_barrier_destroy(&run.held);
+    pthread_barrier_destroy(&run.measured);
+
+    // Every round performs workingSet gets and releases, plus the final fill
+    double operations = (double)threads * workingSet * (OPERATIONS_PER_THREAD / workingSet + 1);
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("%-6s\t%zu\t%d\t%d\t%.2f\t", strategyNames[strategy], objectSize, workingSet, threads,
+           ns / operations);
+    if (strategy == STRATEGY_POOL)
+    {
+        printf("%.2f\t", 100.0 * atomic_load(&run.poolHits) / operations);
+    }
+    else
+    {
+        printf("-\t");
+    }
+    if (misses >= 0)
+    {
+        printf("%.3f\t", misses / operations);
+    }
+    else
+    {
+        printf("n/a\t");
+    }
+    printf("%ld\n", rss);
+}
+
+int main()
+{
+    printf("pool from avoidingOverhead.c, POOL_STATS=%d\n", POOL_STATS);
+    printf("method\tsize\tset\tthreads\tns/op\thit %%\tmiss/op\trss KiB\n");
+    for (size_t size = MIN_OBJECT; size <= MAX_OBJECT; size *= 2)
+    {
+        for (size_t w = 0; w < sizeof(workingSets) / sizeof(workingSets[0]); w++)
+        {
+            int workingSet = workingSets[w];
+            if (size * workingSet > MAX_BYTES_PER_THREAD)
+            {
+                continue;
+            }
+            for (int threads = 1; threads <= MAX_THREADS; threads *= 2)
+            {
+                for (int strategy = STRATEGY_MALLOC; strategy <= STRATEGY_ARENA; strategy++)
+                {
+                    runBenchmark(strategy, size, workingSet, threads);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/*Reading the results: the arena is the floor, since its get is an add and its release is
+free. The pool should track it closely once its free list is warm, and the gap between
+pool and malloc is what pooling buys for that size. As objects grow, the cost of touching
+them comes to dominate, all three columns converge, and a pool only adds resident memory
+for no gain. The RSS column shows that cost: the pool and the arena keep their memory
+between rounds, while malloc may return some of it. Building with -DPOOL_STATS=1 shows
+what the pool's statistics cost. The two clock readings per get and return can easily
+cost more than the malloc the pool saves, which is why they are off by default.*/
@@ -0,0 +1,208 @@
+// Prefetching While Traversing a List
+
+/*Traversing a linked list is pointer chasing. The address of each node is only known once
+the previous node has been loaded, and the address of its data only once the node itself
+has arrived. When the nodes are scattered over the heap, almost every step is a cache miss,
+and the processor spends the traversal waiting for memory one load at a time.
+
+The chain of nodes cannot be loaded any faster than one miss after another, but the wait
+can be put to use. A second pointer runs a fixed distance ahead of the one being visited.
+As it moves, it asks the processor to start loading the node after it and that node's
+data, with a software prefetch. By the time the traversal itself reaches those nodes,
+their data is already in the cache, and the misses on the data overlap with the misses
+on the chain instead of following them.
+
+The right distance depends on the machine and on how much work each visit does, so it is
+a parameter. A distance of zero turns prefetching off.*/
+
+// Compile with: gcc -O2 prefetchList.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+typedef void (*DISPLAY)(void *);
+
+void displayEmployee(Employee *employee)
+{
+    printf("%s\t%d\n", employee->name, employee->age);
+}
+
+typedef struct _node
+{
+    void *data;
+    struct _node *next;
+} Node;
+
+typedef struct _linkedList
+{
+    Node *head;
+    Node *tail;
+    Node *current;
+} LinkedList;
+
+/*A DISPLAY function receives only the data, which is fine for printing but leaves a visit
+that computes something nowhere to put its result. A VISITOR also receives a context
+pointer supplied by the caller, such as a running total:*/
+
+typedef void (*VISITOR)(void *data, void *context);
+
+/*visitPrefetch walks the list with the current pointer, like traverse in Linkedlist.c, and
+keeps ahead distance nodes in front of it. Before the walk starts, ahead is moved into
+place, prefetching the data of each node it passes. On every step it then prefetches the
+node after it and its data, and moves on one node. __builtin_prefetch never faults, so
+prefetching through a NULL pointer at the end of the list is harmless:*/
+
+void visitPrefetch(LinkedList *list, VISITOR visit, void *context, int distance)
+{
+    Node *ahead = list->head;
+    for (int i = 0; i < distance && ahead != NULL; i++)
+    {
+        __builtin_prefetch(ahead->data);
+        ahead = ahead->next;
+    }
+    list->current = list->head;
+    while (list->current != NULL)
+    {
+        if (ahead != NULL)
+        {
+            __builtin_prefetch(ahead->next);
+            __builtin_prefetch(ahead->data);
+            ahead = ahead->next;
+        }
+        visit(list->current->data, context);
+        list->current = list->current->next;
+    }
+}
+
+/*traversePrefetch offers the same traversal with a DISPLAY function, as a drop-in
+replacement for traverse:*/
+
+void callDisplay(void *data, void *context)
+{
+    ((DISPLAY)context)(data);
+}
+
+void traversePrefetch(LinkedList *list, DISPLAY display, int distance)
+{
+    visitPrefetch(list, callDisplay, (void *)display, distance);
+}
+
+/*The benchmark links the same employees in three ways. In the compact list, nodes and
+employees are linked in the order they sit in memory, as they would be straight after
+being allocated from a pool. In the second list, the nodes are still compact but each
+points at an employee chosen at random, as when a pool-allocated list refers to records
+allocated elsewhere. In the scattered list, nodes and employees are both linked in a
+random order, which is what a long-lived heap looks like after many insertions and
+deletions. Each list is traversed with a visitor that adds up the ages, at several
+prefetch distances. The arrays are much larger than the last-level cache:*/
+
+#define EMPLOYEES 4000000
+#define REPEAT 3
+
+void sumAges(void *data, void *context)
+{
+    *(long *)context += ((Employee *)data)->age;
+}
+
+double elapsedMilliseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// The i-th node of the list is nodes[nodeOrder[i]], and it holds employees[dataOrder[i]]:
+
+void linkList(LinkedList *list, Node *nodes, Employee *employees, long *nodeOrder, long *dataOrder, long count)
+{
+    for (long i = 0; i < count; i++)
+    {
+        nodes[nodeOrder[i]].data = &employees[dataOrder[i]];
+        nodes[nodeOrder[i]].next = i + 1 < count ? &nodes[nodeOrder[i + 1]] : NULL;
+    }
+    list->head = &nodes[nodeOrder[0]];
+    list->tail = &nodes[nodeOrder[count - 1]];
+    list->current = NULL;
+}
+
+int main()
+{
+    Employee *employees = (Employee *)malloc(EMPLOYEES * sizeof(Employee));
+    Node *nodes = (Node *)malloc(EMPLOYEES * sizeof(Node));
+    long *sequential = (long *)malloc(EMPLOYEES * sizeof(long));
+    long *shuffled = (long *)malloc(EMPLOYEES * sizeof(long));
+    long expected = 0;
+    for (long i = 0; i < EMPLOYEES; i++)
+    {
+        snprintf(employees[i].name, sizeof(employees[i].name), "employee%ld", i);
+        employees[i].age = (unsigned char)(18 + i % 50);
+        expected += employees[i].age;
+        sequential[i] = i;
+        shuffled[i] = i;
+    }
+    unsigned long state = 5;
+    for (long i = EMPLOYEES - 1; i > 0; i--)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        long j = (long)((state >> 33) % (unsigned long)(i + 1));
+        long swap = shuffled[i];
+        shuffled[i] = shuffled[j];
+        shuffled[j] = swap;
+    }
+
+    int distances[] = {0, 1, 2, 4, 8, 16, 32};
+    const char *layouts[] = {"compact", "scattered data", "scattered"};
+    long *nodeOrders[] = {sequential, sequential, shuffled};
+    long *dataOrders[] = {sequential, shuffled, shuffled};
+    printf("layout\t\tdistance\tns/node\tspeedup\n");
+    for (int layout = 0; layout < 3; layout++)
+    {
+        LinkedList list;
+        linkList(&list, nodes, employees, nodeOrders[layout], dataOrders[layout], EMPLOYEES);
+
+        double baseline = 0;
+        for (int d = 0; d < (int)(sizeof(distances) / sizeof(distances[0])); d++)
+        {
+            double best = 1e30;
+            long total = 0;
+            for (int r = 0; r < REPEAT; r++)
+            {
+                struct timespec start, end;
+                total = 0;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                visitPrefetch(&list, sumAges, &total, distances[d]);
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                double ms = elapsedMilliseconds(&start, &end);
+                best = ms < best ? ms : best;
+            }
+            if (d == 0)
+            {
+                baseline = best;
+            }
+            printf("%-16s%d\t\t%.2f\t%.2fx%s\n", layouts[layout], distances[d], best * 1e6 / EMPLOYEES,
+                   baseline / best, total == expected ? "" : "\tWRONG TOTAL");
+        }
+    }
+
+    free(shuffled);
+    free(sequential);
+    free(nodes);
+    free(employees);
+    return 0;
+}
+
+/*Prefetching helps less than one might hope, and the reason is worth knowing. An
+out-of-order processor does not wait for one employee to arrive before following the next
+node: the load of each employee is independent of the chain, so the processor already
+overlaps several of them by itself. Software prefetching extends that overlap beyond what
+the processor's instruction window can see, which gains around ten percent on the lists
+with scattered data here, more when each visit does enough work to fill the window.
+On the fully scattered list the chain of nodes dominates. It can only be followed one miss
+after another, prefetching or not, and the real remedy is the one in Linkedlist.c:
+allocate the nodes from a pool so they stay close together. A distance far larger than
+needed can lose some of the gain again, as prefetched lines are evicted before use.*/
@@ -0,0 +1,411 @@
+// Queues and Stacks on a Ring Buffer
+
+/*A queue built on the linked list in Linkedlist.c adds a node at the tail for every
+enqueue and deletes the head for every dequeue, so each element that passes through
+costs one allocation and one free. The elements are also spread wherever the allocator
+placed their nodes.
+
+A ring buffer holds the elements in one array instead. Two numbers describe the contents:
+the index of the first element and the number of elements. Adding at the back writes
+just past the last element and removing from the front advances the first index, both
+wrapping around the end of the array. Once the array is large enough for the most
+elements the queue ever holds, enqueue and dequeue never allocate again.
+
+The capacity is kept a power of two, so wrapping an index is a bitwise AND with
+capacity - 1 rather than a division. When the array is full it doubles. The buffer can
+hold whole records inline, such as Employee structures, or just pointers to them. The
+element size is chosen when the buffer is created.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+typedef void (*DISPLAY)(void *);
+
+void displayEmployee(Employee *employee)
+{
+    printf("%s\t%d\n", employee->name, employee->age);
+}
+
+/*indirect records whether the elements are pointers. It only matters when the contents
+are displayed, since a DISPLAY function expects a pointer to the data itself:*/
+
+typedef struct _ringBuffer
+{
+    char *items;
+    size_t elementSize;
+    size_t capacity;
+    size_t first;
+    size_t count;
+    int indirect;
+} RingBuffer;
+
+int initializeRingBuffer(RingBuffer *ring, size_t elementSize, size_t capacity, int indirect)
+{
+    size_t rounded = 1;
+    while (rounded < capacity)
+    {
+        rounded <<= 1;
+    }
+    ring->items = (char *)malloc(rounded * elementSize);
+    ring->elementSize = elementSize;
+    ring->capacity = ring->items != NULL ? rounded : 0;
+    ring->first = 0;
+    ring->count = 0;
+    ring->indirect = indirect;
+    return ring->items != NULL;
+}
+
+void destroyRingBuffer(RingBuffer *ring)
+{
+    free(ring->items);
+    ring->items = NULL;
+    ring->capacity = 0;
+    ring->count = 0;
+}
+
+void *ringElement(RingBuffer *ring, size_t index)
+{
+    return ring->items + ((ring->first + index) & (ring->capacity - 1)) * ring->elementSize;
+}
+
+/*Elements are copied in and out with memcpy. Since the size is only known at run time,
+the compiler cannot turn the copy into a single move, and every element would cost a call
+into the C library. Pointers are by far the most common element, so copyElement gives
+them a separate path that the compiler does turn into one load and one store:*/
+
+void copyElement(void *destination, const void *source, size_t size)
+{
+    if (size == sizeof(void *))
+    {
+        memcpy(destination, source, sizeof(void *));
+    }
+    else
+    {
+        memcpy(destination, source, size);
+    }
+}
+
+/*growRingBuffer doubles the array with realloc. If the contents wrapped around the old end,
+the elements that were at the start of the array now belong after the old end, so they
+are moved there. The first index does not change:*/
+
+int growRingBuffer(RingBuffer *ring)
+{
+    size_t capacity = ring->capacity * 2;
+    char *items = (char *)realloc(ring->items, capacity * ring->elementSize);
+    if (items == NULL)
+    {
+        return 0;
+    }
+    size_t wrapped = ring->first + ring->count > ring->capacity ? ring->first + ring->count - ring->capacity : 0;
+    memcpy(items + ring->capacity * ring->elementSize, items, wrapped * ring->elementSize);
+    ring->items = items;
+    ring->capacity = capacity;
+    return 1;
+}
+
+/*The four basic operations work at either end. pushBack and pushFront copy elementSize
+bytes from the element passed, and return 0 only if the buffer had to grow and could not.
+popFront and popBack copy the element out to the destination passed, and return 0 if the
+buffer is empty:*/
+
+int pushBack(RingBuffer *ring, const void *element)
+{
+    if (ring->count == ring->capacity && !growRingBuffer(ring))
+    {
+        return 0;
+    }
+    copyElement(ringElement(ring, ring->count), element, ring->elementSize);
+    ring->count++;
+    return 1;
+}
+
+int pushFront(RingBuffer *ring, const void *element)
+{
+    if (ring->count == ring->capacity && !growRingBuffer(ring))
+    {
+        return 0;
+    }
+    ring->first = (ring->first - 1) & (ring->capacity - 1);
+    copyElement(ringElement(ring, 0), element, ring->elementSize);
+    ring->count++;
+    return 1;
+}
+
+int popFront(RingBuffer *ring, void *destination)
+{
+    if (ring->count == 0)
+    {
+        return 0;
+    }
+    copyElement(destination, ringElement(ring, 0), ring->elementSize);
+    ring->first = (ring->first + 1) & (ring->capacity - 1);
+    ring->count--;
+    return 1;
+}
+
+int popBack(RingBuffer *ring, void *destination)
+{
+    if (ring->count == 0)
+    {
+        return 0;
+    }
+    ring->count--;
+    copyElement(destination, ringElement(ring, ring->count), ring->elementSize);
+    return 1;
+}
+
+/*displayRingBuffer passes each element to a DISPLAY function in the order given, front to
+back or back to front. For a buffer of pointers, the pointer stored in the element is
+passed rather than the element's address:*/
+
+void displayRingBuffer(RingBuffer *ring, DISPLAY display, int backward)
+{
+    for (size_t i = 0; i < ring->count; i++)
+    {
+        void *element = ringElement(ring, backward ? ring->count - 1 - i : i);
+        display(ring->indirect ? *(void **)element : element);
+    }
+}
+
+/*Queue and Stack
+The adaptors give the ring buffer the usual names. A queue adds at the back and removes
+from the front; a stack adds and removes at the back. Each wraps a RingBuffer, so it is
+just as easy to make a queue of Employee records as a queue of pointers to them:*/
+
+typedef struct _queue
+{
+    RingBuffer ring;
+} Queue;
+
+int initializeQueue(Queue *queue, size_t elementSize, size_t capacity, int indirect)
+{
+    return initializeRingBuffer(&queue->ring, elementSize, capacity, indirect);
+}
+
+int enqueue(Queue *queue, const void *element)
+{
+    return pushBack(&queue->ring, element);
+}
+
+int dequeue(Queue *queue, void *destination)
+{
+    return popFront(&queue->ring, destination);
+}
+
+// displayQueue shows the elements in the order they will be dequeued:
+
+void displayQueue(Queue *queue, DISPLAY display)
+{
+    printf("\nQueue\n");
+    displayRingBuffer(&queue->ring, display, 0);
+}
+
+void destroyQueue(Queue *queue)
+{
+    destroyRingBuffer(&queue->ring);
+}
+
+typedef struct _stack
+{
+    RingBuffer ring;
+} Stack;
+
+int initializeStack(Stack *stack, size_t elementSize, size_t capacity, int indirect)
+{
+    return initializeRingBuffer(&stack->ring, elementSize, capacity, indirect);
+}
+
+int push(Stack *stack, const void *element)
+{
+    return pushBack(&stack->ring, element);
+}
+
+int pop(Stack *stack, void *destination)
+{
+    return popBack(&stack->ring, destination);
+}
+
+// displayStack shows the elements from the top down, the order they will be popped:
+
+void displayStack(Stack *stack, DISPLAY display)
+{
+    printf("\nStack\n");
+    displayRingBuffer(&stack->ring, display, 1);
+}
+
+void destroyStack(Stack *stack)
+{
+    destroyRingBuffer(&stack->ring);
+}
+
+/*For comparison, the node-based queue the linked list implies: enqueue mallocs a node and
+links it at the tail, and dequeue unlinks the head and frees it:*/
+
+typedef struct _node
+{
+    void *data;
+    struct _node *next;
+} Node;
+
+typedef struct _nodeQueue
+{
+    Node *head;
+    Node *tail;
+} NodeQueue;
+
+int enqueueNode(NodeQueue *queue, void *data)
+{
+    Node *node = (Node *)malloc(sizeof(Node));
+    if (node == NULL)
+    {
+        return 0;
+    }
+    node->data = data;
+    node->next = NULL;
+    if (queue->tail == NULL)
+    {
+        queue->head = node;
+    }
+    else
+    {
+        queue->tail->next = node;
+    }
+    queue->tail = node;
+    return 1;
+}
+
+void *dequeueNode(NodeQueue *queue)
+{
+    Node *node = queue->head;
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    void *data = node->data;
+    queue->head = node->next;
+    if (queue->head == NULL)
+    {
+        queue->tail = NULL;
+    }
+    free(node);
+    return data;
+}
+
+/*The benchmark keeps each queue at a steady depth and then performs pairs of enqueue and
+dequeue, the pattern of a producer and consumer working at the same rate. The node queue
+calls malloc and free once per pair. The ring buffers, one holding pointers and one
+holding whole Employee records, reach their final size while being filled and never
+allocate again:*/
+
+#define OPERATIONS 20000000
+#define DEPTH 1000
+
+double elapsedMilliseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int main()
+{
+    Employee employees[3] = {{"Samuel", 32}, {"Sally", 28}, {"Susan", 45}};
+
+    Queue queue;
+    initializeQueue(&queue, sizeof(Employee), 2, 0);
+    Stack stack;
+    initializeStack(&stack, sizeof(Employee *), 2, 1);
+    for (int i = 0; i < 3; i++)
+    {
+        Employee *employee = &employees[i];
+        enqueue(&queue, employee);
+        push(&stack, &employee);
+    }
+    displayQueue(&queue, (DISPLAY)displayEmployee);
+    displayStack(&stack, (DISPLAY)displayEmployee);
+    Employee first;
+    Employee *top;
+    dequeue(&queue, &first);
+    pop(&stack, &top);
+    printf("\nDequeued %s, popped %s\n", first.name, top->name);
+    destroyStack(&stack);
+    destroyQueue(&queue);
+
+    struct timespec start, end;
+    long checksum[3] = {0, 0, 0};
+
+    NodeQueue nodes = {NULL, NULL};
+    for (int i = 0; i < DEPTH; i++)
+    {
+        enqueueNode(&nodes, &employees[i % 3]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < OPERATIONS; i++)
+    {
+        enqueueNode(&nodes, &employees[i % 3]);
+        checksum[0] += ((Employee *)dequeueNode(&nodes))->age;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double nodeMs = elapsedMilliseconds(&start, &end);
+    while (dequeueNode(&nodes) != NULL)
+    {
+    }
+
+    Queue pointers;
+    initializeQueue(&pointers, sizeof(Employee *), 16, 1);
+    for (int i = 0; i < DEPTH; i++)
+    {
+        Employee *employee = &employees[i % 3];
+        enqueue(&pointers, &employee);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < OPERATIONS; i++)
+    {
+        Employee *employee = &employees[i % 3];
+        enqueue(&pointers, &employee);
+        dequeue(&pointers, &employee);
+        checksum[1] += employee->age;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double pointerMs = elapsedMilliseconds(&start, &end);
+    destroyQueue(&pointers);
+
+    Queue records;
+    initializeQueue(&records, sizeof(Employee), 16, 0);
+    for (int i = 0; i < DEPTH; i++)
+    {
+        enqueue(&records, &employees[i % 3]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < OPERATIONS; i++)
+    {
+        Employee employee;
+        enqueue(&records, &employees[i % 3]);
+        dequeue(&records, &employee);
+        checksum[2] += employee.age;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double recordMs = elapsedMilliseconds(&start, &end);
+    destroyQueue(&records);
+
+    printf("\nqueue\t\tns per enqueue+dequeue\n");
+    printf("nodes\t\t%.2f\n", nodeMs * 1e6 / OPERATIONS);
+    printf("ring pointers\t%.2f\n", pointerMs * 1e6 / OPERATIONS);
+    printf("ring records\t%.2f%s\n", recordMs * 1e6 / OPERATIONS,
+           checksum[0] == checksum[1] && checksum[1] == checksum[2] ? "" : "\tCHECKSUM MISMATCH");
+    return 0;
+}
+
+/*With a single thread, malloc and free recycle the same node over and over, so the node
+queue is not as slow as it could be. It is slower still in a real program, where other
+allocations come in between and the nodes end up scattered. The ring buffers do no
+allocation at all in the timed loop and touch a fixed block of memory that stays in the
+cache. Copying whole records costs a little more per operation than copying pointers,
+but saves the caller from allocating and freeing the records themselves.*/
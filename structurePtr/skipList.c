@@ -0,0 +1,366 @@
+// Skip List
+
+/*Keeping a linked list sorted makes it easy to display in order, but finding an employee
+by name, or the place to insert a new one, still means walking the list from the head.
+With a million employees that is half a million calls to compareEmployee on average.
+
+A skip list keeps the sorted linked list and adds express lanes above it. Every node is
+on level 0, the ordinary list. About one node in four is also linked on level 1, one in
+sixteen on level 2, and so on. A search starts on the highest level, moves right while
+the next node still precedes the key, and drops down a level when it would overshoot.
+Each level skips over roughly four nodes of the level below, so a search takes an
+expected O(log n) steps. Insertion and deletion are a search followed by relinking the
+nodes on each level the node occupies.
+
+A node's level is chosen at random when it is inserted, so no rebalancing is ever
+needed. The node is allocated with exactly as many forward pointers as its level
+requires, using a flexible array member:*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_LEVEL 24
+#define LEVEL_CHUNK (1 << 16)
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+typedef void (*DISPLAY)(void *);
+typedef int (*COMPARE)(void *, void *);
+
+int compareEmployee(Employee *e1, Employee *e2)
+{
+    return strcmp(e1->name, e2->name);
+}
+
+void displayEmployee(Employee *employee)
+{
+    printf("%s\t%d\n", employee->name, employee->age);
+}
+
+typedef struct _skipNode
+{
+    void *data;
+    int level;
+    struct _skipNode *forward[];
+} SkipNode;
+
+/*Nodes come from a pool, as in “Avoiding malloc/free Overhead,” but since nodes of
+different levels have different sizes, the pool keeps one free list per level. New nodes
+are carved out of large chunks by bumping an offset, and a deleted node goes on the free
+list for its level, where the next node of that level will find it. Three quarters of all
+nodes are level 1, so that free list is where most of the reuse happens:*/
+
+typedef struct _levelChunk
+{
+    struct _levelChunk *next;
+    char memory[];
+} LevelChunk;
+
+typedef struct _levelPool
+{
+    SkipNode *free[MAX_LEVEL + 1];
+    LevelChunk *chunks;
+    size_t used;
+} LevelPool;
+
+size_t nodeSize(int level)
+{
+    return sizeof(SkipNode) + level * sizeof(SkipNode *);
+}
+
+SkipNode *allocateSkipNode(LevelPool *pool, int level)
+{
+    SkipNode *node = pool->free[level];
+    if (node != NULL)
+    {
+        pool->free[level] = node->forward[0];
+        return node;
+    }
+    size_t size = nodeSize(level);
+    if (pool->chunks == NULL || pool->used + size > LEVEL_CHUNK)
+    {
+        LevelChunk *chunk = (LevelChunk *)malloc(sizeof(LevelChunk) + LEVEL_CHUNK);
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+        pool->used = 0;
+    }
+    node = (SkipNode *)(pool->chunks->memory + pool->used);
+    pool->used += size;
+    node->level = level;
+    return node;
+}
+
+void releaseSkipNode(LevelPool *pool, SkipNode *node)
+{
+    node->forward[0] = pool->free[node->level];
+    pool->free[node->level] = node;
+}
+
+/*The SkipList structure holds a header node with MAX_LEVEL forward pointers, the COMPARE
+function that orders the list, and the highest level currently in use:*/
+
+typedef struct _skipList
+{
+    SkipNode *header;
+    COMPARE compare;
+    int level;
+    size_t count;
+    unsigned long seed;
+    LevelPool pool;
+} SkipList;
+
+void initializeSkipList(SkipList *list, COMPARE compare)
+{
+    memset(&list->pool, 0, sizeof(list->pool));
+    list->header = (SkipNode *)calloc(1, nodeSize(MAX_LEVEL));
+    list->header->level = MAX_LEVEL;
+    list->compare = compare;
+    list->level = 1;
+    list->count = 0;
+    list->seed = 88172645463325252UL;
+}
+
+void destroySkipList(SkipList *list)
+{
+    while (list->pool.chunks != NULL)
+    {
+        LevelChunk *next = list->pool.chunks->next;
+        free(list->pool.chunks);
+        list->pool.chunks = next;
+    }
+    free(list->header);
+    list->header = NULL;
+}
+
+/*randomLevel draws 64 random bits from an xorshift generator and counts pairs of zero
+bits. Each pair is zero with probability one quarter, which gives the one-in-four
+promotion rate described above:*/
+
+int randomLevel(SkipList *list)
+{
+    unsigned long x = list->seed;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    list->seed = x;
+    int level = 1;
+    while (level < MAX_LEVEL && (x & 3) == 0)
+    {
+        level++;
+        x >>= 2;
+    }
+    return level;
+}
+
+/*findPredecessors performs the search. For each level it records the last node that
+precedes the key, which is where insertSkip and deleteSkip splice. It returns the node on
+level 0 after those predecessors, the first node that does not precede the key:*/
+
+SkipNode *findPredecessors(SkipList *list, void *key, SkipNode **update)
+{
+    SkipNode *node = list->header;
+    for (int i = list->level - 1; i >= 0; i--)
+    {
+        while (node->forward[i] != NULL && list->compare(node->forward[i]->data, key) < 0)
+        {
+            node = node->forward[i];
+        }
+        if (update != NULL)
+        {
+            update[i] = node;
+        }
+    }
+    return node->forward[0];
+}
+
+void *findSkip(SkipList *list, void *key)
+{
+    SkipNode *node = findPredecessors(list, key, NULL);
+    return node != NULL && list->compare(node->data, key) == 0 ? node->data : NULL;
+}
+
+/*insertSkip adds data unless an element comparing equal is already present, in which case
+it returns 0 and leaves the list unchanged:*/
+
+int insertSkip(SkipList *list, void *data)
+{
+    SkipNode *update[MAX_LEVEL];
+    SkipNode *next = findPredecessors(list, data, update);
+    if (next != NULL && list->compare(next->data, data) == 0)
+    {
+        return 0;
+    }
+    int level = randomLevel(list);
+    for (int i = list->level; i < level; i++)
+    {
+        update[i] = list->header;
+    }
+    if (level > list->level)
+    {
+        list->level = level;
+    }
+    SkipNode *node = allocateSkipNode(&list->pool, level);
+    node->data = data;
+    for (int i = 0; i < level; i++)
+    {
+        node->forward[i] = update[i]->forward[i];
+        update[i]->forward[i] = node;
+    }
+    list->count++;
+    return 1;
+}
+
+// deleteSkip unlinks the matching node on every level and returns its data, or NULL:
+
+void *deleteSkip(SkipList *list, void *key)
+{
+    SkipNode *update[MAX_LEVEL];
+    SkipNode *node = findPredecessors(list, key, update);
+    if (node == NULL || list->compare(node->data, key) != 0)
+    {
+        return NULL;
+    }
+    for (int i = 0; i < node->level; i++)
+    {
+        update[i]->forward[i] = node->forward[i];
+    }
+    while (list->level > 1 && list->header->forward[list->level - 1] == NULL)
+    {
+        list->level--;
+    }
+    void *data = node->data;
+    releaseSkipNode(&list->pool, node);
+    list->count--;
+    return data;
+}
+
+/*Range iteration finds the first element not less than low in O(log n) and then walks
+level 0 in order, visiting each element until one follows high. The cost is the search
+plus the number of elements visited:*/
+
+void traverseRange(SkipList *list, void *low, void *high, DISPLAY visit)
+{
+    SkipNode *node = findPredecessors(list, low, NULL);
+    while (node != NULL && list->compare(node->data, high) <= 0)
+    {
+        visit(node->data);
+        node = node->forward[0];
+    }
+}
+
+void traverseSkip(SkipList *list, DISPLAY visit)
+{
+    for (SkipNode *node = list->header->forward[0]; node != NULL; node = node->forward[0])
+    {
+        visit(node->data);
+    }
+}
+
+/*The benchmark inserts employees in random order, looks each one up, runs range queries
+and deletes them all. The size defaults to one million and can be given on the command
+line, for example ./skipList 10000000:*/
+
+double elapsedNanoseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char **argv)
+{
+    SkipList list;
+    initializeSkipList(&list, (COMPARE)compareEmployee);
+
+    const char *names[] = {"Susan", "Samuel", "Sally", "Bob", "Zed", "Alice"};
+    Employee small[6];
+    for (int i = 0; i < 6; i++)
+    {
+        strcpy(small[i].name, names[i]);
+        small[i].age = (unsigned char)(30 + i);
+        insertSkip(&list, &small[i]);
+    }
+    deleteSkip(&list, &small[2]);
+    traverseSkip(&list, (DISPLAY)displayEmployee);
+    Employee low = {"B", 0}, high = {"Sb", 0};
+    printf("Range B..Sb\n");
+    traverseRange(&list, &low, &high, (DISPLAY)displayEmployee);
+    destroySkipList(&list);
+
+    long count = argc > 1 ? atol(argv[1]) : 1000000;
+    Employee *employees = (Employee *)malloc(count * sizeof(Employee));
+    for (long i = 0; i < count; i++)
+    {
+        snprintf(employees[i].name, sizeof(employees[i].name), "employee%09ld", i);
+        employees[i].age = (unsigned char)(i % 100);
+    }
+    unsigned long state = 12345;
+    for (long i = count - 1; i > 0; i--)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        long j = (long)((state >> 33) % (unsigned long)(i + 1));
+        Employee swap = employees[i];
+        employees[i] = employees[j];
+        employees[j] = swap;
+    }
+
+    struct timespec start, end;
+    initializeSkipList(&list, (COMPARE)compareEmployee);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < count; i++)
+    {
+        insertSkip(&list, &employees[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("\n%ld employees, %d levels\n", count, list.level);
+    printf("insert: %.0f ns/op\n", elapsedNanoseconds(&start, &end) / count);
+
+    long found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < count; i++)
+    {
+        found += findSkip(&list, &employees[i]) != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("find:   %.0f ns/op (%ld found)\n", elapsedNanoseconds(&start, &end) / count, found);
+
+    // Each range covers 100 consecutive ids
+    long visited = 0;
+    int ranges = 10000;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < ranges; r++)
+    {
+        long first = (long)((unsigned long)r * 7919 % (unsigned long)count);
+        snprintf(low.name, sizeof(low.name), "employee%09ld", first);
+        snprintf(high.name, sizeof(high.name), "employee%09ld", first + 99);
+        SkipNode *node = findPredecessors(&list, &low, NULL);
+        while (node != NULL && compareEmployee(node->data, &high) <= 0)
+        {
+            visited++;
+            node = node->forward[0];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("range:  %.0f ns per 100-element range (%ld visited)\n",
+           elapsedNanoseconds(&start, &end) / ranges, visited);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < count; i++)
+    {
+        deleteSkip(&list, &employees[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("delete: %.0f ns/op (%zu left)\n", elapsedNanoseconds(&start, &end) / count, list.count);
+
+    destroySkipList(&list);
+    free(employees);
+    return 0;
+}
+
+/*Find costs grow with log n, so going from a million to ten million employees adds only
+a couple of levels to each search, although more of each search misses the cache. The
+sorted list in Linkedlist.c needs on the order of n comparisons for the same find.*/
@@ -0,0 +1,246 @@
+// Slab-Backed Pools
+
+/*The pool in avoidingOverhead.c still calls malloc once for every Person it cannot find on
+its free list, and each of those persons ends up wherever the heap puts it. A slab pool
+asks the heap for memory in larger pieces. A slab is one contiguous block that holds
+SLAB_OBJECTS objects side by side, so a slab of persons is a small array of persons.
+Objects used together tend to be allocated together and therefore sit on the same
+cache lines and pages, and one malloc now serves 64 gets.
+
+Each slab keeps a 64-bit occupancy bitmap with one bit per object. A set bit means the
+object is free. Finding a free object is a find-first-set on that word, which compilers
+turn into a single instruction, and freeing one is setting its bit again. When every bit
+of a slab is set, the whole slab is unused and can be handed back in one call to free.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SLAB_OBJECTS 64
+#define SLAB_MIN_BYTES 4096
+#define SLAB_ALL_FREE UINT64_MAX
+
+typedef struct person
+{
+    int a;
+    char b;
+} Person;
+
+/*The Slab header sits at the start of the block and is followed by the objects. Slabs that
+have at least one free object are kept on a doubly linked partial list so that a slab can
+be removed from the middle of it when it fills up or empties:*/
+
+typedef struct _slab
+{
+    struct _slab *next;
+    struct _slab *prev;
+    uint64_t freeMask;
+    char *objects;
+} Slab;
+
+/*The slab size is a power of two, and every slab is allocated on a boundary of that size
+with aligned_alloc. The slab owning any object can then be found by clearing the low bits
+of the object's address, without storing anything in the object. The spare field keeps
+one empty slab around so that a pool hovering at a slab boundary does not allocate and
+free a slab on every call:*/
+
+typedef struct _slabPool
+{
+    Slab *partial;
+    Slab *spare;
+    size_t objectSize;
+    size_t slabBytes;
+    size_t slabCount;
+} SlabPool;
+
+void initializeSlabPool(SlabPool *pool, size_t objectSize)
+{
+    size_t align = _Alignof(max_align_t);
+    size_t headerBytes = (sizeof(Slab) + align - 1) & ~(align - 1);
+    pool->objectSize = (objectSize + align - 1) & ~(align - 1);
+    pool->slabBytes = SLAB_MIN_BYTES;
+    while (pool->slabBytes < headerBytes + SLAB_OBJECTS * pool->objectSize)
+    {
+        pool->slabBytes *= 2;
+    }
+    pool->partial = NULL;
+    pool->spare = NULL;
+    pool->slabCount = 0;
+}
+
+Slab *allocateSlab(SlabPool *pool)
+{
+    Slab *slab = (Slab *)aligned_alloc(pool->slabBytes, pool->slabBytes);
+    if (slab == NULL)
+    {
+        return NULL;
+    }
+    size_t align = _Alignof(max_align_t);
+    slab->objects = (char *)slab + ((sizeof(Slab) + align - 1) & ~(align - 1));
+    slab->freeMask = SLAB_ALL_FREE;
+    slab->next = NULL;
+    slab->prev = NULL;
+    pool->slabCount++;
+    return slab;
+}
+
+void releaseSlab(SlabPool *pool, Slab *slab)
+{
+    free(slab);
+    pool->slabCount--;
+}
+
+void linkPartial(SlabPool *pool, Slab *slab)
+{
+    slab->prev = NULL;
+    slab->next = pool->partial;
+    if (pool->partial != NULL)
+    {
+        pool->partial->prev = slab;
+    }
+    pool->partial = slab;
+}
+
+void unlinkPartial(SlabPool *pool, Slab *slab)
+{
+    if (slab->prev != NULL)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        pool->partial = slab->next;
+    }
+    if (slab->next != NULL)
+    {
+        slab->next->prev = slab->prev;
+    }
+}
+
+/*slabGet takes the first partial slab, or the spare, or a new slab when there is neither.
+The lowest set bit of its freeMask is the free object with the lowest address, which keeps
+allocations packed at the front of the slab. A slab whose last free bit is cleared leaves
+the partial list:*/
+
+void *slabGet(SlabPool *pool)
+{
+    Slab *slab = pool->partial;
+    if (slab == NULL)
+    {
+        slab = pool->spare;
+        pool->spare = NULL;
+        if (slab == NULL)
+        {
+            slab = allocateSlab(pool);
+            if (slab == NULL)
+            {
+                return NULL;
+            }
+        }
+        linkPartial(pool, slab);
+    }
+    int index = __builtin_ctzll(slab->freeMask);
+    slab->freeMask &= slab->freeMask - 1;
+    if (slab->freeMask == 0)
+    {
+        unlinkPartial(pool, slab);
+    }
+    return slab->objects + index * pool->objectSize;
+}
+
+/*slabReturn finds the slab from the object's address and sets the object's bit. A slab that
+was full rejoins the partial list. A slab that becomes completely free either becomes the
+spare or, if there already is one, is released immediately:*/
+
+void slabReturn(SlabPool *pool, void *object)
+{
+    Slab *slab = (Slab *)((uintptr_t)object & ~(uintptr_t)(pool->slabBytes - 1));
+    size_t index = ((char *)object - slab->objects) / pool->objectSize;
+    if (slab->freeMask == 0)
+    {
+        linkPartial(pool, slab);
+    }
+    slab->freeMask |= (uint64_t)1 << index;
+    if (slab->freeMask == SLAB_ALL_FREE)
+    {
+        unlinkPartial(pool, slab);
+        if (pool->spare == NULL)
+        {
+            pool->spare = slab;
+        }
+        else
+        {
+            releaseSlab(pool, slab);
+        }
+    }
+}
+
+/*Destroying the pool releases the partial slabs and the spare. Full slabs are not on any
+list, so every object must be returned before the pool is destroyed:*/
+
+void destroySlabPool(SlabPool *pool)
+{
+    while (pool->partial != NULL)
+    {
+        Slab *slab = pool->partial;
+        pool->partial = slab->next;
+        releaseSlab(pool, slab);
+    }
+    if (pool->spare != NULL)
+    {
+        releaseSlab(pool, pool->spare);
+        pool->spare = NULL;
+    }
+}
+
+// The getPerson and returnPerson functions from avoidingOverhead.c now draw on a slab pool:
+
+SlabPool personPool;
+
+Person *getPerson()
+{
+    return (Person *)slabGet(&personPool);
+}
+
+void returnPerson(Person *person)
+{
+    slabReturn(&personPool, person);
+}
+
+int main()
+{
+    initializeSlabPool(&personPool, sizeof(Person));
+
+    // Consecutive persons are adjacent in memory, objectSize bytes apart
+    Person *first = getPerson();
+    Person *second = getPerson();
+    printf("%p %p (%td bytes apart)\n", (void *)first, (void *)second,
+           (char *)second - (char *)first);
+    returnPerson(second);
+    returnPerson(first);
+
+    // 1000 persons need only 16 slabs, that is 16 calls to aligned_alloc instead of 1000 mallocs
+    Person *persons[1000];
+    for (int i = 0; i < 1000; i++)
+    {
+        persons[i] = getPerson();
+        persons[i]->a = i;
+    }
+    printf("slabs in use: %zu of %zu bytes each\n", personPool.slabCount, personPool.slabBytes);
+
+    // Returning every person empties the slabs, and all but the spare are released
+    for (int i = 0; i < 1000; i++)
+    {
+        returnPerson(persons[i]);
+    }
+    printf("slabs after return: %zu\n", personPool.slabCount);
+
+    destroySlabPool(&personPool);
+    return 0;
+}
+
+/*A slab holds SLAB_OBJECTS objects whatever their size, so for a small structure like
+Person most of a 4 KiB slab is unused. Structures of up to 48 bytes fit in 4 KiB, and
+larger ones get a larger power-of-two slab. When many small objects are needed, SLAB_MIN_BYTES
+can be lowered, or the single freeMask word replaced with an array of them.*/
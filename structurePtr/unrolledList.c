@@ -0,0 +1,429 @@
+// Unrolled Linked List
+
+/*In the single-linked list of Linkedlist.c, every element costs two pointer hops: one to
+reach the Node and one to reach the Employee its data field points to. Neither is likely
+to be near the last one in memory, so a traversal tends to take two cache misses per
+element, and the processor cannot fetch ahead because it does not know the next address
+until the current node has arrived.
+
+An unrolled linked list stores several elements in each node. The employees are copied
+into an array inside the node, so a traversal reads them sequentially and only follows a
+pointer once per node. The node is sized to UNROLLED_BYTES, two 64-byte cache lines by
+default, and aligned to a cache line so it never straddles more lines than it needs.
+
+Nodes do not have to be full. Inserting into a full node splits it into two half-full
+nodes, and a node that drops below half full after a deletion is merged with a
+neighbour when their elements fit in one node. This keeps the list at least half dense
+without ever moving more than one node's worth of elements.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+typedef struct _employee
+{
+    char name[32];
+    unsigned char age;
+} Employee;
+
+typedef void (*DISPLAY)(void *);
+typedef int (*COMPARE)(void *, void *);
+
+int compareEmployee(Employee *e1, Employee *e2)
+{
+    return strcmp(e1->name, e2->name);
+}
+
+void displayEmployee(Employee *employee)
+{
+    printf("%s\t%d\n", employee->name, employee->age);
+}
+
+#define UNROLLED_BYTES 128
+#define UNROLLED_CAPACITY ((UNROLLED_BYTES - 2 * sizeof(void *)) / sizeof(Employee))
+
+typedef struct _unrolledNode
+{
+    _Alignas(64) struct _unrolledNode *next;
+    int count;
+    Employee items[UNROLLED_CAPACITY];
+} UnrolledNode;
+
+typedef struct _unrolledList
+{
+    UnrolledNode *head;
+    UnrolledNode *tail;
+    size_t count;
+} UnrolledList;
+
+UnrolledNode *allocateUnrolledNode()
+{
+    UnrolledNode *node = (UnrolledNode *)aligned_alloc(_Alignof(UnrolledNode), sizeof(UnrolledNode));
+    node->next = NULL;
+    node->count = 0;
+    return node;
+}
+
+void initializeUnrolledList(UnrolledList *list)
+{
+    list->head = NULL;
+    list->tail = NULL;
+    list->count = 0;
+}
+
+void destroyUnrolledList(UnrolledList *list)
+{
+    UnrolledNode *node = list->head;
+    while (node != NULL)
+    {
+        UnrolledNode *next = node->next;
+        free(node);
+        node = next;
+    }
+    initializeUnrolledList(list);
+}
+
+/*addUnrolledTail appends a copy of an employee to the last node, starting a new node when
+it is full. Building a list this way leaves every node but the last one full:*/
+
+void addUnrolledTail(UnrolledList *list, Employee *employee)
+{
+    UnrolledNode *tail = list->tail;
+    if (tail == NULL || tail->count == UNROLLED_CAPACITY)
+    {
+        UnrolledNode *node = allocateUnrolledNode();
+        if (tail == NULL)
+        {
+            list->head = node;
+        }
+        else
+        {
+            tail->next = node;
+        }
+        list->tail = node;
+        tail = node;
+    }
+    tail->items[tail->count++] = *employee;
+    list->count++;
+}
+
+/*splitNode moves the upper half of a full node into a new node linked right after it.
+insertUnrolledSorted uses it to make room, then places the employee into whichever half
+it belongs to:*/
+
+UnrolledNode *splitNode(UnrolledList *list, UnrolledNode *node)
+{
+    UnrolledNode *upper = allocateUnrolledNode();
+    int keep = node->count / 2;
+    upper->count = node->count - keep;
+    memcpy(upper->items, node->items + keep, upper->count * sizeof(Employee));
+    node->count = keep;
+    upper->next = node->next;
+    node->next = upper;
+    if (list->tail == node)
+    {
+        list->tail = upper;
+    }
+    return upper;
+}
+
+void insertUnrolledSorted(UnrolledList *list, COMPARE compare, Employee *employee)
+{
+    if (list->head == NULL)
+    {
+        addUnrolledTail(list, employee);
+        return;
+    }
+
+    // The employee goes into the first node whose last element follows it, or the tail
+    UnrolledNode *node = list->head;
+    while (node->next != NULL && compare(employee, &node->items[node->count - 1]) >= 0)
+    {
+        node = node->next;
+    }
+    if (node->count == UNROLLED_CAPACITY)
+    {
+        UnrolledNode *upper = splitNode(list, node);
+        if (compare(employee, &upper->items[0]) >= 0)
+        {
+            node = upper;
+        }
+    }
+
+    int position = 0;
+    while (position < node->count && compare(employee, &node->items[position]) >= 0)
+    {
+        position++;
+    }
+    memmove(node->items + position + 1, node->items + position,
+            (node->count - position) * sizeof(Employee));
+    node->items[position] = *employee;
+    node->count++;
+    list->count++;
+}
+
+/*findUnrolled returns a pointer to the first stored employee that matches, or NULL. The
+pointer refers to the copy inside the list and is only valid until the list changes:*/
+
+Employee *findUnrolled(UnrolledList *list, COMPARE compare, Employee *key)
+{
+    for (UnrolledNode *node = list->head; node != NULL; node = node->next)
+    {
+        for (int i = 0; i < node->count; i++)
+        {
+            if (compare(&node->items[i], key) == 0)
+            {
+                return &node->items[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+/*deleteUnrolled removes the first employee that matches and closes the gap. An empty node
+is unlinked and freed. A node that falls below half full is appended to its predecessor
+when the two fit in one node, and otherwise absorbs its successor if that fits. Trying the
+predecessor first matters when deletions sweep forward through the list, since the
+successor is then still full while the predecessor has already been thinned out:*/
+
+int deleteUnrolled(UnrolledList *list, COMPARE compare, Employee *key)
+{
+    UnrolledNode *previous = NULL;
+    for (UnrolledNode *node = list->head; node != NULL; previous = node, node = node->next)
+    {
+        for (int i = 0; i < node->count; i++)
+        {
+            if (compare(&node->items[i], key) != 0)
+            {
+                continue;
+            }
+            memmove(node->items + i, node->items + i + 1, (node->count - i - 1) * sizeof(Employee));
+            node->count--;
+            list->count--;
+
+            if (node->count == 0)
+            {
+                if (previous == NULL)
+                {
+                    list->head = node->next;
+                }
+                else
+                {
+                    previous->next = node->next;
+                }
+                if (list->tail == node)
+                {
+                    list->tail = previous;
+                }
+                free(node);
+            }
+            else if (2 * node->count < (int)UNROLLED_CAPACITY && previous != NULL &&
+                     previous->count + node->count <= (int)UNROLLED_CAPACITY)
+            {
+                memcpy(previous->items + previous->count, node->items, node->count * sizeof(Employee));
+                previous->count += node->count;
+                previous->next = node->next;
+                if (list->tail == node)
+                {
+                    list->tail = previous;
+                }
+                free(node);
+            }
+            else if (2 * node->count < (int)UNROLLED_CAPACITY && node->next != NULL &&
+                     node->count + node->next->count <= (int)UNROLLED_CAPACITY)
+            {
+                UnrolledNode *next = node->next;
+                memcpy(node->items + node->count, next->items, next->count * sizeof(Employee));
+                node->count += next->count;
+                node->next = next->next;
+                if (list->tail == next)
+                {
+                    list->tail = node;
+                }
+                free(next);
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+size_t countUnrolledNodes(UnrolledList *list)
+{
+    size_t nodes = 0;
+    for (UnrolledNode *node = list->head; node != NULL; node = node->next)
+    {
+        nodes++;
+    }
+    return nodes;
+}
+
+void traverseUnrolled(UnrolledList *list, DISPLAY visit)
+{
+    for (UnrolledNode *node = list->head; node != NULL; node = node->next)
+    {
+        for (int i = 0; i < node->count; i++)
+        {
+            visit(&node->items[i]);
+        }
+    }
+}
+
+/*For the benchmark, the classic list from Linkedlist.c is reproduced with its two
+allocations per element. A long-running program allocates and frees in no particular
+order, so after the nodes are allocated they are linked in a shuffled order. Following
+the list then jumps around the heap the way it would in practice:*/
+
+typedef struct _node
+{
+    void *data;
+    struct _node *next;
+} Node;
+
+#define ELEMENTS 1000000
+#define SEARCHES 20
+
+unsigned long nextRandom(unsigned long *state)
+{
+    *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+    return *state >> 33;
+}
+
+double elapsedMilliseconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int main()
+{
+    UnrolledList list;
+    initializeUnrolledList(&list);
+    const char *names[] = {"Susan", "Samuel", "Sally", "Bob", "Zed", "Alice", "Mary"};
+    for (int i = 0; i < 7; i++)
+    {
+        Employee employee = {"", (unsigned char)(20 + i)};
+        strcpy(employee.name, names[i]);
+        insertUnrolledSorted(&list, (COMPARE)compareEmployee, &employee);
+    }
+    Employee key = {"Sally", 0};
+    deleteUnrolled(&list, (COMPARE)compareEmployee, &key);
+    printf("%zu employees, %zu per node\n", list.count, UNROLLED_CAPACITY);
+    traverseUnrolled(&list, (DISPLAY)displayEmployee);
+    destroyUnrolledList(&list);
+
+    /*Deleting two of every three employees from a list of full nodes leaves each node
+    with one element, below half full, so the deletions must merge nodes and the list has
+    to end up with fewer nodes than it started with:*/
+    for (int i = 0; i < 30; i++)
+    {
+        Employee employee = {"", (unsigned char)i};
+        snprintf(employee.name, sizeof(employee.name), "employee%02d", i);
+        addUnrolledTail(&list, &employee);
+    }
+    size_t fullNodes = countUnrolledNodes(&list);
+    for (int i = 0; i < 30; i++)
+    {
+        if (i % 3 != 0)
+        {
+            snprintf(key.name, sizeof(key.name), "employee%02d", i);
+            deleteUnrolled(&list, (COMPARE)compareEmployee, &key);
+        }
+    }
+    size_t sparseNodes = countUnrolledNodes(&list);
+    printf("%zu nodes before deleting, %zu after\n", fullNodes, sparseNodes);
+    assert(list.count == 10);
+    assert(sparseNodes < fullNodes);
+    destroyUnrolledList(&list);
+
+    // Build both lists with the same ELEMENTS employees
+    unsigned long state = 1;
+    Node **nodes = (Node **)malloc(ELEMENTS * sizeof(Node *));
+    for (int i = 0; i < ELEMENTS; i++)
+    {
+        Employee employee = {"", (unsigned char)(i % 100)};
+        snprintf(employee.name, sizeof(employee.name), "employee%07d", i);
+        addUnrolledTail(&list, &employee);
+        nodes[i] = (Node *)malloc(sizeof(Node));
+        nodes[i]->data = malloc(sizeof(Employee));
+        *(Employee *)nodes[i]->data = employee;
+    }
+    for (int i = ELEMENTS - 1; i > 0; i--)
+    {
+        int j = nextRandom(&state) % (i + 1);
+        Node *swap = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = swap;
+    }
+    for (int i = 0; i < ELEMENTS - 1; i++)
+    {
+        nodes[i]->next = nodes[i + 1];
+    }
+    nodes[ELEMENTS - 1]->next = NULL;
+    Node *head = nodes[0];
+
+    // A scan reads every age; find searches for names spread across the list
+    struct timespec start, end;
+    long sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (Node *node = head; node != NULL; node = node->next)
+    {
+        sum += ((Employee *)node->data)->age;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("classic scan:   %8.2f ms (sum %ld)\n", elapsedMilliseconds(&start, &end), sum);
+
+    sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (UnrolledNode *node = list.head; node != NULL; node = node->next)
+    {
+        for (int i = 0; i < node->count; i++)
+        {
+            sum += node->items[i].age;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("unrolled scan:  %8.2f ms (sum %ld)\n", elapsedMilliseconds(&start, &end), sum);
+
+    int found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int s = 0; s < SEARCHES; s++)
+    {
+        snprintf(key.name, sizeof(key.name), "employee%07d", (int)(nextRandom(&state) % ELEMENTS));
+        for (Node *node = head; node != NULL; node = node->next)
+        {
+            if (compareEmployee((Employee *)node->data, &key) == 0)
+            {
+                found++;
+                break;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("classic find:   %8.2f ms per search (%d found)\n", elapsedMilliseconds(&start, &end) / SEARCHES, found);
+
+    found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int s = 0; s < SEARCHES; s++)
+    {
+        snprintf(key.name, sizeof(key.name), "employee%07d", (int)(nextRandom(&state) % ELEMENTS));
+        found += findUnrolled(&list, (COMPARE)compareEmployee, &key) != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("unrolled find:  %8.2f ms per search (%d found)\n", elapsedMilliseconds(&start, &end) / SEARCHES, found);
+
+    for (int i = 0; i < ELEMENTS; i++)
+    {
+        free(nodes[i]->data);
+        free(nodes[i]);
+    }
+    free(nodes);
+    destroyUnrolledList(&list);
+    return 0;
+}
+
+/*With the default two cache lines, a node holds three employees, so a scan follows one
+pointer for every three elements instead of two pointers for every element, and the
+elements within a node arrive together. Raising UNROLLED_BYTES packs more employees per
+node and helps scans further, at the cost of moving more data on each split and merge.*/